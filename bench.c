@@ -0,0 +1,51 @@
+/*
+ * bench.c - What the churn and scratch benchmarks share: the random
+ *    numbers that make a run the same for the same seed, and how they
+ *    use and check the blocks they get
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+
+unsigned long long random_seed = 1;
+
+/*
+ * next_random - xorshift, the same run for the same seed on every build
+ */
+unsigned long next_random(void)
+{
+    random_seed ^= random_seed << 13;
+    random_seed ^= random_seed >> 7;
+    random_seed ^= random_seed << 17;
+    return (unsigned long)(random_seed >> 1);
+}
+
+/*
+ * checked - Stop when an allocation of size bytes failed
+ */
+void *checked(void *p, size_t size)
+{
+    if (p == NULL) {
+	fprintf(stderr, "ERROR: allocating %lu bytes failed\n", (unsigned long)size);
+	exit(1);
+    }
+    return p;
+}
+
+/*
+ * touch - Write both ends of a new block like a real user would
+ */
+void touch(char *p, size_t size)
+{
+    p[0] = p[size - 1] = 1;
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+void unix_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
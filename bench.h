@@ -0,0 +1,11 @@
+/*
+ * bench.h - What the churn and scratch benchmarks share
+ */
+#include <stddef.h>
+
+extern unsigned long long random_seed; /* state of the random number generator (-s) */
+
+unsigned long next_random(void);
+void *checked(void *p, size_t size);
+void touch(char *p, size_t size);
+void unix_error(char *msg);
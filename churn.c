@@ -0,0 +1,245 @@
+/*
+ * churn.c - Long running fragmentation benchmark for mm.c
+ *
+ * Allocates and frees random blocks for a long time, the way a server
+ * heap lives, and every interval prints how much of the heap is in use
+ * and how the free memory is spread out. Most blocks die young but some
+ * of them live long, and the number of live blocks rises and falls in
+ * waves between a quarter of the most and the most, so the long lived
+ * ones end up pinning the heap wherever the allocator put them. Build
+ * it with different free list orders (make fragmentation) to see how
+ * the heap holds up over time.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+#include "bench.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define LONG_PCT      5 /* percent of the blocks that are long lived */
+#define LONG_LIFE    10 /* times longer a long lived block lives on average */
+#define WAVES         4 /* times the live blocks rise and fall over a run */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* The live blocks of one lifetime, freed in random order */
+typedef struct {
+    char **blocks;       /* payload pointers */
+    size_t *sizes;       /* requested sizes */
+    int count;           /* live blocks */
+} pool_t;
+
+/********************
+ * Global variables
+ *******************/
+
+static size_t live_bytes; /* payload bytes asked for and not freed yet */
+static int hinted;        /* tell mm_malloc_hint which pool a block goes to (-o) */
+
+/*********************
+ * Function prototypes
+ *********************/
+static size_t random_size(void);
+static void pool_init(pool_t *pool, int max);
+static void pool_alloc(pool_t *pool, mm_hint_t hint);
+static void pool_free(pool_t *pool);
+static void usage(void);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+    long op;
+    long num_ops = 2000000;       /* requests in the whole run (-n) */
+    long interval = 0;            /* requests between reports (-i) */
+    int max_live = 4096;          /* most blocks live at once (-l) */
+    size_t max_heap = 256 << 20;  /* most the heap can grow to (-m) */
+    long wave, phase;
+    int live, target;
+    pool_t young, old;
+    mm_stats_t stats;
+    struct timespec start, end;
+    double secs, util, sum_util = 0;
+    int reports = 0;
+
+    while ((c = getopt(argc, argv, "n:i:l:s:m:oh")) != EOF) {
+        switch (c) {
+        case 'n': /* Requests in the run */
+            num_ops = atol(optarg);
+            break;
+        case 'i': /* Requests between reports */
+            interval = atol(optarg);
+            break;
+        case 'l': /* Most live blocks */
+            max_live = atoi(optarg);
+            break;
+        case 's': /* Seed of the random numbers */
+            random_seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+        case 'm': /* Most the heap can grow to */
+            max_heap = (size_t)atol(optarg) << 20;
+            break;
+        case 'o': /* Hint every block with the pool it goes to */
+            hinted = 1;
+            break;
+        case 'h': /* Print this message */
+	    usage();
+            exit(0);
+        default:
+	    usage();
+            exit(1);
+        }
+    }
+    if (interval <= 0)
+        interval = num_ops / 20;
+    if (num_ops <= 0 || interval <= 0 || max_live < 2) {
+        usage();
+        exit(1);
+    }
+    if ((wave = num_ops / WAVES) < 2)
+        wave = 2;
+
+    pool_init(&young, max_live);
+    pool_init(&old, max_live);
+    mem_configure(max_heap, 0);
+    mem_init();
+    if (mm_init() < 0) {
+	fprintf(stderr, "ERROR: mm_init failed\n");
+	exit(1);
+    }
+
+    printf("      ops   live(KB)   heap(KB)  util  free(KB) largest(KB)  frag    Kops\n");
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (op = 1; op <= num_ops; op++) {
+	/* the live blocks follow a target that goes up in one half of a wave and down in the other */
+	live = young.count + old.count;
+	phase = op % wave;
+	if (phase > wave / 2)
+	    phase = wave - phase;
+	target = max_live / 4 + (long)(max_live - max_live / 4) * phase / (wave / 2);
+
+	if (live == 0 || (live < max_live && (int)(next_random() % 64) < 32 + target - live)) {
+	    if (next_random() % 100 < LONG_PCT)
+		pool_alloc(&old, LONG_LIVED);
+	    else
+		pool_alloc(&young, SHORT_LIVED);
+	}
+	else if (next_random() % ((unsigned long)young.count * LONG_LIFE + old.count) < (unsigned long)old.count) {
+	    pool_free(&old); /* every long lived block is LONG_LIFE times less likely to go */
+	}
+	else {
+	    pool_free(&young);
+	}
+
+	if (op % interval == 0) {
+	    clock_gettime(CLOCK_MONOTONIC, &end);
+	    secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	    mm_stats(&stats);
+	    util = stats.heap_bytes ? (double)live_bytes / stats.heap_bytes : 0;
+	    sum_util += util;
+	    reports++;
+	    printf("%9ld %10lu %10lu %4.0f%% %9lu %11lu %4.0f%% %7.0f\n",
+		   op,
+		   (unsigned long)(live_bytes / 1024),
+		   (unsigned long)(stats.heap_bytes / 1024),
+		   util * 100,
+		   (unsigned long)(stats.cached_bytes / 1024),
+		   (unsigned long)(stats.largest_free / 1024),
+		   stats.cached_bytes ? (1 - (double)stats.largest_free / stats.cached_bytes) * 100 : 0,
+		   interval / secs / 1e3);
+	    clock_gettime(CLOCK_MONOTONIC, &start); /* the stats walk isn't timed */
+	}
+    }
+    printf("Average util = %.0f%%\n", reports ? sum_util / reports * 100 : 0);
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * random_size - Mostly small blocks, some medium ones and a few big buffers
+ */
+static size_t random_size(void)
+{
+    unsigned long r = next_random() % 100;
+
+    if (r < 70)
+	return 16 + next_random() % 496;
+    if (r < 95)
+	return 512 + next_random() % 7680;
+    return 8192 + next_random() % 24576;
+}
+
+/*
+ * pool_init - Make room for max live blocks
+ */
+static void pool_init(pool_t *pool, int max)
+{
+    pool->count = 0;
+    if ((pool->blocks = malloc(max * sizeof(char *))) == NULL ||
+	(pool->sizes = malloc(max * sizeof(size_t))) == NULL)
+	unix_error("ERROR: malloc failed in pool_init");
+}
+
+/*
+ * pool_alloc - Allocate a block of random size in to the pool, with -o
+ *    the allocator is told how long the pool's blocks live
+ */
+static void pool_alloc(pool_t *pool, mm_hint_t hint)
+{
+    size_t size = random_size();
+    char *p;
+
+    if ((p = hinted ? mm_malloc_hint(size, hint) : mm_malloc(size)) == NULL) {
+	fprintf(stderr, "ERROR: mm_malloc failed with %lu bytes live\n",
+		(unsigned long)live_bytes);
+	exit(1);
+    }
+    touch(p, size);
+    pool->blocks[pool->count] = p;
+    pool->sizes[pool->count] = size;
+    pool->count++;
+    live_bytes += size;
+}
+
+/*
+ * pool_free - Free a random block of the pool, the last one takes its place
+ */
+static void pool_free(pool_t *pool)
+{
+    int i = next_random() % pool->count;
+
+    mm_free(pool->blocks[i]);
+    live_bytes -= pool->sizes[i];
+    pool->count--;
+    pool->blocks[i] = pool->blocks[pool->count];
+    pool->sizes[i] = pool->sizes[pool->count];
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: churn [-ho] [-n <ops>] [-i <ops>] [-l <blocks>] [-s <seed>] [-m <MB>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-i <ops>      Report every <ops> requests (default a twentieth of the run).\n");
+    fprintf(stderr, "\t-l <blocks>   Keep at most <blocks> blocks live (default 4096).\n");
+    fprintf(stderr, "\t-m <MB>       Let the heap grow to <MB> megabytes (default 256).\n");
+    fprintf(stderr, "\t-n <ops>      Run for <ops> requests (default 2000000).\n");
+    fprintf(stderr, "\t-o            Hint the young blocks short lived and the old ones long lived.\n");
+    fprintf(stderr, "\t-s <seed>     Seed the random sizes and lifetimes.\n");
+}
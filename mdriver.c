@@ -31,7 +31,7 @@
 #define LINENUM(i) (i+5) /* cnvt trace request nums to linenums (origin 1) */
 
 /* Returns true if p is ALIGNMENT-byte aligned */
-#define IS_ALIGNED(p)  ((((unsigned int)(p)) % ALIGNMENT) == 0)
+#define IS_ALIGNED(p)  ((((size_t)(p)) % ALIGNMENT) == 0)
 
 /****************************** 
  * The key compound data types 
@@ -48,7 +48,8 @@ typedef struct range_t {
 typedef struct {
     enum {ALLOC, FREE, REALLOC} type; /* type of request */
     int index;                        /* index for free() to use later */
-    int size;                         /* byte size of alloc/realloc request */
+    size_t size;                      /* byte size of alloc/realloc request */
+    mm_hint_t hint;                   /* how long an alloc lives, set by -o */
 } traceop_t;
 
 /* Holds the information for one trace file*/
@@ -81,6 +82,14 @@ typedef struct {
 
     /* defined only for the student malloc package */
     double util;     /* space utilization for this trace (always 0 for libc) */
+    double moves;    /* reallocs that copied the block somewhere else */
+    double stays;    /* reallocs that kept the block in place */
+    double moved;    /* bytes copied by the moves */
+    double saved;    /* bytes the stays didn't have to copy */
+    double sbrks;    /* times the heap grew */
+    double grown;    /* bytes it grew by */
+    double split;    /* smallest remainder mm malloc splits off at the end */
+    double slack;    /* remainder a fit was good enough with at the end */
 
     /* Note: secs and util are only defined if valid is true */
 } stats_t; 
@@ -106,7 +115,7 @@ static char *default_tracefiles[] = {
  *********************/
 
 /* these functions manipulate range lists */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, size_t size, 
 		     int tracenum, int opnum);
 static void remove_range(range_t **ranges, char *lo);
 static void clear_ranges(range_t **ranges);
@@ -114,6 +123,7 @@ static void clear_ranges(range_t **ranges);
 /* These functions read, allocate, and free storage for traces */
 static trace_t *read_trace(char *tracedir, char *filename);
 static void free_trace(trace_t *trace);
+static void hint_trace(trace_t *trace, int short_ops);
 
 /* Routines for evaluating the correctness and speed of libc malloc */
 static int eval_libc_valid(trace_t *trace, int tracenum);
@@ -124,9 +134,13 @@ static void eval_libc_speed(void *ptr);
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges);
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges);
 static void eval_mm_speed(void *ptr);
+static void eval_mm_heapstats(stats_t *stats);
 
 /* Various helper routines */
 static void printresults(int n, stats_t *stats);
+static void printreallocs(int n, stats_t *stats);
+static void printgrowth(int n, stats_t *stats);
+static void printsummary(int n, stats_t *stats);
 static void usage(void);
 static void unix_error(char *msg);
 static void malloc_error(int tracenum, int opnum, char *msg);
@@ -150,6 +164,11 @@ int main(int argc, char **argv)
     int team_check = 1;  /* If set, check team structure (reset by -a) */
     int run_libc = 0;    /* If set, run libc malloc (set by -l) */
     int autograder = 0;  /* If set, emit summary info for autograder (-g) */
+    size_t max_heap = MAX_HEAP; /* Most the heap can grow to (set by -m) */
+    int hugepages = 0;   /* If set, back the heap with huge pages (-H) */
+    int summary = 0;     /* If set, print util and Kops of every trace on a line (-s) */
+    size_t extend_min, extend_max; /* Heap growth steps (set by -x) */
+    int short_ops = 0;   /* If set, hint blocks freed within this many ops as short lived (-o) */
 
     /* temporaries used to compute the performance index */
     double secs, ops, util, avg_mm_util, avg_mm_throughput, p1, p2, perfindex;
@@ -158,7 +177,7 @@ int main(int argc, char **argv)
     /* 
      * Read and interpret the command line arguments 
      */
-    while ((c = getopt(argc, argv, "f:t:hvVgal")) != EOF) {
+    while ((c = getopt(argc, argv, "f:t:m:o:x:hvVgalHs")) != EOF) {
         switch (c) {
 	case 'g': /* Generate summary info for the autograder */
 	    autograder = 1;
@@ -190,6 +209,28 @@ int main(int argc, char **argv)
         case 'V': /* Be more verbose than -v */
             verbose = 2;
             break;
+        case 'm': /* Most the heap can grow to */
+            max_heap = (size_t)atol(optarg) << 20;
+            break;
+        case 'H': /* Transparent huge pages for the heap */
+            hugepages = 1;
+            break;
+        case 'o': /* Tell mm_malloc_hint how long every block will live */
+            if ((short_ops = atoi(optarg)) <= 0) {
+		usage();
+		exit(1);
+	    }
+            break;
+        case 's': /* One line summaries to compare builds side by side */
+            summary = 1;
+            break;
+        case 'x': /* Smallest and biggest step the heap grows by */
+            if (sscanf(optarg, "%zu,%zu", &extend_min, &extend_max) != 2) {
+		usage();
+		exit(1);
+	    }
+	    mm_set_extend(extend_min, extend_max);
+            break;
         case 'h': /* Print this message */
 	    usage();
             exit(0);
@@ -293,11 +334,14 @@ int main(int argc, char **argv)
 	unix_error("mm_stats calloc in main failed");
     
     /* Initialize the simulated memory system in memlib.c */
+    mem_configure(max_heap, hugepages);
     mem_init(); 
 
     /* Evaluate student's mm malloc package using the K-best scheme */
     for (i=0; i < num_tracefiles; i++) {
 	trace = read_trace(tracedir, tracefiles[i]);
+	if (short_ops)
+	    hint_trace(trace, short_ops);
 	mm_stats[i].ops = trace->num_ops;
 	if (verbose > 1)
 	    printf("Checking mm_malloc for correctness, ");
@@ -306,6 +350,7 @@ int main(int argc, char **argv)
 	    if (verbose > 1)
 		printf("efficiency, ");
 	    mm_stats[i].util = eval_mm_util(trace, i, &ranges);
+	    eval_mm_heapstats(&mm_stats[i]);
 	    speed_params.trace = trace;
 	    speed_params.ranges = ranges;
 	    if (verbose > 1)
@@ -320,7 +365,11 @@ int main(int argc, char **argv)
 	printf("\nResults for mm malloc:\n");
 	printresults(num_tracefiles, mm_stats);
 	printf("\n");
+	printreallocs(num_tracefiles, mm_stats);
+	printgrowth(num_tracefiles, mm_stats);
     }
+    if (summary)
+	printsummary(num_tracefiles, mm_stats);
 
     /* 
      * Accumulate the aggregate statistics for the student's mm package 
@@ -386,7 +435,7 @@ int main(int argc, char **argv)
  *     size bytes at addr lo. After checking the block for correctness,
  *     we create a range struct for this block and add it to the range list. 
  */
-static int add_range(range_t **ranges, char *lo, int size, 
+static int add_range(range_t **ranges, char *lo, size_t size, 
 		     int tracenum, int opnum)
 {
     char *hi = lo + size - 1;
@@ -403,9 +452,10 @@ static int add_range(range_t **ranges, char *lo, int size,
         return 0;
     }
 
-    /* The payload must lie within the extent of the heap */
-    if ((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
-	(hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) {
+    /* The payload must lie within the extent of the heap, of another region or of a mapping */
+    if (((lo < (char *)mem_heap_lo()) || (lo > (char *)mem_heap_hi()) || 
+	 (hi < (char *)mem_heap_lo()) || (hi > (char *)mem_heap_hi())) &&
+	!mem_in_region(lo, hi) && !mem_is_mapped(lo, hi)) {
 	sprintf(msg, "Payload (%p:%p) lies outside heap (%p:%p)",
 		lo, hi, mem_heap_lo(), mem_heap_hi());
 	malloc_error(tracenum, opnum, msg);
@@ -485,7 +535,8 @@ static trace_t *read_trace(char *tracedir, char *filename)
     trace_t *trace;
     char type[MAXLINE];
     char path[MAXLINE];
-    unsigned index, size;
+    unsigned index;
+    size_t size;
     unsigned max_index = 0;
     unsigned op_index;
 
@@ -529,14 +580,15 @@ static trace_t *read_trace(char *tracedir, char *filename)
     while (fscanf(tracefile, "%s", type) != EOF) {
 	switch(type[0]) {
 	case 'a':
-	    fscanf(tracefile, "%u %u", &index, &size);
+	    fscanf(tracefile, "%u %zu", &index, &size);
 	    trace->ops[op_index].type = ALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
+	    trace->ops[op_index].hint = LIFETIME_UNKNOWN;
 	    max_index = (index > max_index) ? index : max_index;
 	    break;
 	case 'r':
-	    fscanf(tracefile, "%u %u", &index, &size);
+	    fscanf(tracefile, "%u %zu", &index, &size);
 	    trace->ops[op_index].type = REALLOC;
 	    trace->ops[op_index].index = index;
 	    trace->ops[op_index].size = size;
@@ -574,6 +626,40 @@ void free_trace(trace_t *trace)
     free(trace);              /* and the trace record itself... */
 }
 
+/*
+ * hint_trace - Play oracle: look ahead to when each block is freed and
+ *              hint the ones freed within short_ops requests of their
+ *              alloc as short lived, the rest (and those never freed)
+ *              as long lived. A realloc carries the block on.
+ */
+static void hint_trace(trace_t *trace, int short_ops)
+{
+    int i, index;
+    int *death; /* op that frees each id next, going backwards */
+
+    if ((death = (int *)malloc(trace->num_ids * sizeof(int))) == NULL)
+	unix_error("malloc failed in hint_trace");
+    for (i = 0; i < trace->num_ids; i++)
+	death[i] = -1;
+
+    for (i = trace->num_ops - 1; i >= 0; i--) {
+	index = trace->ops[i].index;
+	switch (trace->ops[i].type) {
+	case FREE:
+	    death[index] = i;
+	    break;
+	case ALLOC:
+	    trace->ops[i].hint = death[index] >= 0 && death[index] - i < short_ops ?
+		SHORT_LIVED : LONG_LIVED;
+	    death[index] = -1;
+	    break;
+	default:
+	    break;
+	}
+    }
+    free(death);
+}
+
 /**********************************************************************
  * The following functions evaluate the correctness, space utilization,
  * and throughput of the libc and mm malloc packages.
@@ -584,10 +670,9 @@ void free_trace(trace_t *trace)
  */
 static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges) 
 {
-    int i, j;
+    int i;
     int index;
-    int size;
-    int oldsize;
+    size_t j, size, oldsize;
     char *newp;
     char *oldp;
     char *p;
@@ -611,8 +696,9 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
 
         case ALLOC: /* mm_malloc */
 
-	    /* Call the student's malloc */
-	    if ((p = mm_malloc(size)) == NULL) {
+	    /* Call the student's malloc, with the lifetime when -o knows it */
+	    if ((p = trace->ops[i].hint != LIFETIME_UNKNOWN ?
+		 mm_malloc_hint(size, trace->ops[i].hint) : mm_malloc(size)) == NULL) {
 		malloc_error(tracenum, i, "mm_malloc failed.");
 		return 0;
 	    }
@@ -697,19 +783,18 @@ static int eval_mm_valid(trace_t *trace, int tracenum, range_t **ranges)
  *   The idea is to remember the high water mark "hwm" of the heap for 
  *   an optimal allocator, i.e., no gaps and no internal fragmentation.
  *   Utilization is the ratio hwm/heapsize, where heapsize is the 
- *   size of the heap in bytes after running the student's malloc 
- *   package on the trace. Note that our implementation of mem_sbrk() 
- *   doesn't allow the students to decrement the brk pointer, so brk
- *   is always the high water mark of the heap. 
+ *   high water mark of the heap in bytes while running the student's
+ *   malloc package on the trace. mem_sbrk() lets the heap shrink, so 
+ *   the size at the end of the trace could be far below its peak.
  *   
  */
 static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 {   
     int i;
     int index;
-    int size, newsize, oldsize;
-    int max_total_size = 0;
-    int total_size = 0;
+    size_t size, newsize, oldsize;
+    size_t max_total_size = 0;
+    size_t total_size = 0;
     char *p;
     char *newp, *oldp;
 
@@ -725,7 +810,8 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
 	    index = trace->ops[i].index;
 	    size = trace->ops[i].size;
 
-	    if ((p = mm_malloc(size)) == NULL) 
+	    if ((p = trace->ops[i].hint != LIFETIME_UNKNOWN ?
+		 mm_malloc_hint(size, trace->ops[i].hint) : mm_malloc(size)) == NULL) 
 		app_error("mm_malloc failed in eval_mm_util");
 	    
 	    /* Remember region and size */
@@ -782,17 +868,38 @@ static double eval_mm_util(trace_t *trace, int tracenum, range_t **ranges)
         }
     }
 
-    return ((double)max_total_size / (double)mem_heapsize());
+    return ((double)max_total_size / (double)mem_peak_heapsize());
 }
 
 
+/*
+ * eval_mm_heapstats - Record how the reallocs of the trace eval_mm_util 
+ *   just ran went, the moves copied the payload and the stays didn't,
+ *   and how often the heap had to grow.
+ */
+static void eval_mm_heapstats(stats_t *stats)
+{
+    mm_stats_t heap;
+
+    mm_stats(&heap);
+    stats->moves = heap.realloc_moves;
+    stats->stays = heap.realloc_stays;
+    stats->moved = heap.moved_bytes;
+    stats->saved = heap.saved_bytes;
+    stats->sbrks = heap.sbrk_calls;
+    stats->grown = heap.sbrk_bytes;
+    stats->split = heap.split_min;
+    stats->slack = heap.fit_slack;
+}
+
 /*
  * eval_mm_speed - This is the function that is used by fcyc()
  *    to measure the running time of the mm malloc package.
  */
 static void eval_mm_speed(void *ptr)
 {
-    int i, index, size, newsize;
+    int i, index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -808,7 +915,8 @@ static void eval_mm_speed(void *ptr)
         case ALLOC: /* mm_malloc */
             index = trace->ops[i].index;
             size = trace->ops[i].size;
-            if ((p = mm_malloc(size)) == NULL)
+            if ((p = trace->ops[i].hint != LIFETIME_UNKNOWN ?
+		 mm_malloc_hint(size, trace->ops[i].hint) : mm_malloc(size)) == NULL)
 		app_error("mm_malloc error in eval_mm_speed");
             trace->blocks[index] = p;
             break;
@@ -841,7 +949,8 @@ static void eval_mm_speed(void *ptr)
  */
 static int eval_libc_valid(trace_t *trace, int tracenum)
 {
-    int i, newsize;
+    int i;
+    size_t newsize;
     char *p, *newp, *oldp;
 
     for (i = 0;  i < trace->num_ops;  i++) {
@@ -885,7 +994,8 @@ static int eval_libc_valid(trace_t *trace, int tracenum)
 static void eval_libc_speed(void *ptr)
 {
     int i;
-    int index, size, newsize;
+    int index;
+    size_t size, newsize;
     char *p, *newp, *oldp, *block;
     trace_t *trace = ((speed_t *)ptr)->trace;
 
@@ -980,6 +1090,122 @@ static void printresults(int n, stats_t *stats)
 
 }
 
+/*
+ * printreallocs - prints how many reallocs of each trace had to copy
+ *   the block and how much copying the in place ones saved
+ */
+static void printreallocs(int n, stats_t *stats) 
+{
+    int i;
+    double moves = 0;
+    double stays = 0;
+    double moved = 0;
+    double saved = 0;
+
+    for (i=0; i < n; i++) {
+	moves += stats[i].moves;
+	stays += stats[i].stays;
+	moved += stats[i].moved;
+	saved += stats[i].saved;
+    }
+    if (moves + stays == 0) /* no reallocs in these traces */
+	return;
+
+    printf("Reallocs for mm malloc:\n");
+    printf("%5s%8s%8s%11s%11s\n", 
+	   "trace", "moved", "stayed", "copied(KB)", "saved(KB)");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid && stats[i].moves + stats[i].stays > 0) {
+	    printf("%2d%11.0f%8.0f%11.0f%11.0f\n", 
+		   i,
+		   stats[i].moves,
+		   stats[i].stays,
+		   stats[i].moved/1024,
+		   stats[i].saved/1024);
+	}
+    }
+    printf("%5s%8.0f%8.0f%11.0f%11.0f\n\n", 
+	   "Total",
+	   moves,
+	   stays,
+	   moved/1024,
+	   saved/1024);
+}
+
+/*
+ * printgrowth - prints how many times the heap grew on each trace
+ *   and by how much, with the split threshold and fit slack the
+ *   allocator ended up with
+ */
+static void printgrowth(int n, stats_t *stats) 
+{
+    int i;
+    double sbrks = 0;
+    double grown = 0;
+
+    printf("Heap growth and fit thresholds for mm malloc:\n");
+    printf("%5s%8s%11s%11s%10s%10s\n", 
+	   "trace", "sbrks", "grown(KB)", "avg(B)", "split(B)", "slack(B)");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%2d%11.0f%11.0f%11.0f%10.0f%10.0f\n", 
+		   i,
+		   stats[i].sbrks,
+		   stats[i].grown/1024,
+		   stats[i].sbrks ? stats[i].grown/stats[i].sbrks : 0,
+		   stats[i].split,
+		   stats[i].slack);
+	    sbrks += stats[i].sbrks;
+	    grown += stats[i].grown;
+	}
+    }
+    printf("%5s%8.0f%11.0f%11.0f\n\n", 
+	   "Total",
+	   sbrks,
+	   grown/1024,
+	   sbrks ? grown/sbrks : 0);
+}
+
+/*
+ * printsummary - Print the utilization and the throughput of every trace
+ * on one line each, so the lines of several builds can be put side by side
+ */
+static void printsummary(int n, stats_t *stats)
+{
+    int i;
+    double secs = 0;
+    double ops = 0;
+    double util = 0;
+
+    printf("%-5s", "trace");
+    for (i=0; i < n; i++)
+	printf("%7d", i);
+    printf("%8s\n", "Total");
+
+    printf("%-5s", "util");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%6.0f%%", stats[i].util*100.0);
+	    util += stats[i].util;
+	}
+	else
+	    printf("%7s", "-");
+    }
+    printf("%7.0f%%\n", (util/n)*100.0);
+
+    printf("%-5s", "Kops");
+    for (i=0; i < n; i++) {
+	if (stats[i].valid) {
+	    printf("%7.0f", (stats[i].ops/1e3)/stats[i].secs);
+	    secs += stats[i].secs;
+	    ops += stats[i].ops;
+	}
+	else
+	    printf("%7s", "-");
+    }
+    printf("%8.0f\n", secs ? (ops/1e3)/secs : 0);
+}
+
 /* 
  * app_error - Report an arbitrary application error
  */
@@ -1012,14 +1238,19 @@ void malloc_error(int tracenum, int opnum, char *msg)
  */
 static void usage(void) 
 {
-    fprintf(stderr, "Usage: mdriver [-hvVal] [-f <file>] [-t <dir>]\n");
+    fprintf(stderr, "Usage: mdriver [-hvValHs] [-f <file>] [-t <dir>] [-m <MB>] [-o <ops>] [-x <min>,<max>]\n");
     fprintf(stderr, "Options\n");
     fprintf(stderr, "\t-a         Don't check the team structure.\n");
     fprintf(stderr, "\t-f <file>  Use <file> as the trace file.\n");
     fprintf(stderr, "\t-g         Generate summary info for autograder.\n");
     fprintf(stderr, "\t-h         Print this message.\n");
+    fprintf(stderr, "\t-H         Ask for transparent huge pages for the heap.\n");
     fprintf(stderr, "\t-l         Run libc malloc as well.\n");
+    fprintf(stderr, "\t-m <MB>    Let the heap grow to <MB> megabytes.\n");
+    fprintf(stderr, "\t-o <ops>   Hint blocks freed within <ops> requests as short lived.\n");
+    fprintf(stderr, "\t-s         Print util and Kops of every trace on one line.\n");
     fprintf(stderr, "\t-t <dir>   Directory to find default traces.\n");
     fprintf(stderr, "\t-v         Print per-trace performance breakdowns.\n");
     fprintf(stderr, "\t-V         Print additional debug info.\n");
+    fprintf(stderr, "\t-x <min>,<max> Grow the heap by <min> to <max> bytes at a time.\n");
 }
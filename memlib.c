@@ -3,6 +3,7 @@
  *            allows us to interleave calls from the student's malloc package 
  *            with the system's malloc package in libc.
  */
+#define _GNU_SOURCE /* for mremap */
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -14,24 +15,71 @@
 #include "memlib.h"
 #include "config.h"
 
+/* A region is one simulated heap with its own brk. Its whole range is */
+/* reserved up front, pages only become usable once the brk reaches them */
+struct mem_region {
+    char *start_brk;  /* points to first byte of heap */
+    char *brk;        /* points to last byte of heap */
+    char *max_addr;   /* largest legal heap address */ 
+    char *commit;     /* first byte past the usable pages */
+    struct mem_region *next; /* the region made before this one */
+};
+
+/* Pages are made usable this many at a time, so not every sbrk needs the system */
+#define COMMIT_UNIT (64*1024)
+#define HUGE_PAGE (2*(1<<20)) /* what a transparent huge page covers on x86-64 */
+
+/* A mapping of its own that mem_map made, outside every heap */
+typedef struct mem_mapping {
+    char *start;                /* first byte of the mapping */
+    size_t size;                /* bytes in it, a multiple of the page size */
+    struct mem_mapping *next;
+} mem_mapping_t;
+
 /* private variables */
-static char *mem_start_brk;  /* points to first byte of heap */
-static char *mem_brk;        /* points to last byte of heap */
-static char *mem_max_addr;   /* largest legal heap address */ 
+static mem_region_t heap;    /* the region mem_init sets up and mem_sbrk works on */
+static mem_region_t *regions; /* every region but the heap */
+static mem_mapping_t *mappings; /* every live mapping */
+static size_t mapped_bytes;  /* all of them together */
+static size_t region_bytes;  /* bytes below the brk of every other region */
+static size_t peak_bytes;    /* most the heap, the regions and the mappings held at once */
+static char maps_lock;       /* spin lock for the five above, any thread may map */
+static size_t max_heap = MAX_HEAP; /* what mem_init reserves for the heap */
+static int hugepages;        /* ask for transparent huge pages on every region */
+
+#define MAPS_LOCK() while (__atomic_test_and_set(&maps_lock, __ATOMIC_ACQUIRE))
+#define MAPS_UNLOCK() __atomic_clear(&maps_lock, __ATOMIC_RELEASE)
+
+static void update_peak(void);
+static char *reserve(size_t size, size_t align);
+static int commit(mem_region_t *r, char *end);
+
+/*
+ * mem_configure - set the most bytes the heap can grow to and whether
+ *    regions ask for transparent huge pages, before mem_init. Without it
+ *    the heap can grow to MAX_HEAP with normal pages
+ */
+void mem_configure(size_t max_bytes, int huge)
+{
+    max_heap = max_bytes;
+    hugepages = huge;
+}
 
 /* 
  * mem_init - initialize the memory system model
  */
 void mem_init(void)
 {
-    /* allocate the storage we will use to model the available VM */
-    if ((mem_start_brk = (char *)malloc(MAX_HEAP)) == NULL) {
-        fprintf(stderr, "mem_init_vm: malloc error\n");
+    /* reserve the address space we will use to model the available VM */
+    if ((heap.start_brk = reserve(max_heap, 0)) == NULL) {
+        fprintf(stderr, "mem_init_vm: mmap error\n");
         exit(1);
     }
 
-    mem_max_addr = mem_start_brk + MAX_HEAP;  /* max legal heap address */
-    mem_brk = mem_start_brk;                  /* heap is empty initially */
+    heap.max_addr = heap.start_brk + max_heap;  /* max legal heap address */
+    heap.brk = heap.start_brk;                  /* heap is empty initially */
+    heap.commit = heap.start_brk;               /* and none of it is usable yet */
+    peak_bytes = 0;
 }
 
 /* 
@@ -39,7 +87,7 @@ void mem_init(void)
  */
 void mem_deinit(void)
 {
-    free(mem_start_brk);
+    munmap(heap.start_brk, heap.max_addr - heap.start_brk);
 }
 
 /*
@@ -47,25 +95,21 @@ void mem_deinit(void)
  */
 void mem_reset_brk()
 {
-    mem_brk = mem_start_brk;
+    heap.brk = heap.start_brk;
+    MAPS_LOCK();
+    peak_bytes = mapped_bytes; /* the regions are counted again the next time any heap moves */
+    MAPS_UNLOCK();
 }
 
 /* 
  * mem_sbrk - simple model of the sbrk function. Extends the heap 
- *    by incr bytes and returns the start address of the new area. In
- *    this model, the heap cannot be shrunk.
+ *    by incr bytes and returns the start address of the new area. A
+ *    negative incr shrinks the heap and returns the old brk. incr is
+ *    pointer wide, so a heap can grow or shrink by more than 2GB at once.
  */
-void *mem_sbrk(int incr) 
+void *mem_sbrk(intptr_t incr) 
 {
-    char *old_brk = mem_brk;
-
-    if ((incr < 0) || ((mem_brk + incr) > mem_max_addr)) {
-        errno = ENOMEM;
-        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
-        return (void *)-1;
-    }
-    mem_brk += incr;
-    return (void *)old_brk;
+    return mem_region_sbrk(&heap, incr);
 }
 
 /*
@@ -73,7 +117,7 @@ void *mem_sbrk(int incr)
  */
 void *mem_heap_lo()
 {
-    return (void *)mem_start_brk;
+    return (void *)heap.start_brk;
 }
 
 /* 
@@ -81,7 +125,7 @@ void *mem_heap_lo()
  */
 void *mem_heap_hi()
 {
-    return (void *)(mem_brk - 1);
+    return (void *)(heap.brk - 1);
 }
 
 /*
@@ -89,7 +133,25 @@ void *mem_heap_hi()
  */
 size_t mem_heapsize() 
 {
-    return (size_t)(mem_brk - mem_start_brk);
+    return (size_t)(heap.brk - heap.start_brk);
+}
+
+/*
+ * mem_peak_heapsize() - returns the most bytes the heap, the other regions
+ *    and the mappings held at once since mem_init or mem_reset_brk
+ */
+size_t mem_peak_heapsize() 
+{
+    return peak_bytes;
+}
+
+/*
+ * mem_max_heapsize() - returns the most bytes the heap can grow to, as
+ *    set by mem_configure
+ */
+size_t mem_max_heapsize()
+{
+    return max_heap;
 }
 
 /*
@@ -99,3 +161,301 @@ size_t mem_pagesize()
 {
     return (size_t)getpagesize();
 }
+
+/*
+ * mem_heap_region - the region behind mem_sbrk, so it can be used
+ *    wherever a region is expected
+ */
+mem_region_t *mem_heap_region(void)
+{
+    return &heap;
+}
+
+/*
+ * mem_region_create - model another heap of at most size bytes, with
+ *    its own brk, next to the one mem_init set up. When size is a power
+ *    of two the region starts at a multiple of it
+ */
+mem_region_t *mem_region_create(size_t size)
+{
+    mem_region_t *r;
+    size_t page = mem_pagesize();
+
+    if ((r = (mem_region_t *)malloc(sizeof(mem_region_t))) == NULL)
+        return NULL;
+    size = (size + page - 1) & ~(page - 1);
+    r->start_brk = reserve(size, (size & (size - 1)) == 0 ? size : 0);
+    if (r->start_brk == NULL) {
+        free(r);
+        return NULL;
+    }
+    r->max_addr = r->start_brk + size;
+    r->brk = r->start_brk;
+    r->commit = r->start_brk;
+    MAPS_LOCK();
+    r->next = regions;
+    regions = r;
+    MAPS_UNLOCK();
+    return r;
+}
+
+/*
+ * mem_region_destroy - give all of a region back at once
+ */
+void mem_region_destroy(mem_region_t *r)
+{
+    mem_region_t **prev;
+
+    MAPS_LOCK();
+    for (prev = &regions; *prev != r; prev = &(*prev)->next)
+        ;
+    *prev = r->next;
+    region_bytes -= r->brk - r->start_brk;
+    MAPS_UNLOCK();
+    munmap(r->start_brk, r->max_addr - r->start_brk);
+    free(r);
+}
+
+/*
+ * mem_region_sbrk - mem_sbrk for a given region. When the heap shrinks
+ *    the whole pages past the new brk are handed back to the system, so
+ *    they stop counting against the process until the heap grows again
+ */
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr)
+{
+    char *old_brk = r->brk;
+    size_t page = mem_pagesize();
+    char *lo, *hi;
+
+    if (incr < r->start_brk - r->brk) {
+        errno = EINVAL;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Heap shrunk below its start...\n");
+        return (void *)-1;
+    }
+    if (incr > r->max_addr - r->brk) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. Ran out of memory...\n");
+        return (void *)-1;
+    }
+    if (r->brk + incr > r->commit && commit(r, r->brk + incr) < 0) {
+        errno = ENOMEM;
+        fprintf(stderr, "ERROR: mem_sbrk failed. The system has no pages left...\n");
+        return (void *)-1;
+    }
+    r->brk += incr;
+    MAPS_LOCK();
+    if (r != &heap)
+        region_bytes += incr;
+    update_peak();
+    MAPS_UNLOCK();
+    if (incr < 0) {
+        lo = (char *)(((size_t)r->brk + page - 1) & ~(page - 1));
+        hi = (char *)((size_t)old_brk & ~(page - 1));
+        if (lo < hi)
+            mem_release(lo, hi - lo);
+    }
+    return (void *)old_brk;
+}
+
+/*
+ * mem_release - hand the pages from start to start+size back to the
+ *    system, they stay in the heap and read as zeros when touched again.
+ *    start and size must be multiples of the page size
+ */
+void mem_release(void *start, size_t size)
+{
+    madvise(start, size, MADV_DONTNEED);
+}
+
+/*
+ * mem_map - a page aligned mapping of its own of size bytes, rounded up
+ *    to whole pages, or NULL when the system has none to give
+ */
+void *mem_map(size_t size)
+{
+    mem_mapping_t *m;
+    size_t page = mem_pagesize();
+    void *start;
+
+    size = (size + page - 1) & ~(page - 1);
+    if ((m = (mem_mapping_t *)malloc(sizeof(mem_mapping_t))) == NULL)
+        return NULL;
+    start = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (start == MAP_FAILED) {
+        free(m);
+        return NULL;
+    }
+    m->start = start;
+    m->size = size;
+    MAPS_LOCK();
+    m->next = mappings;
+    mappings = m;
+    mapped_bytes += size;
+    update_peak();
+    MAPS_UNLOCK();
+    return start;
+}
+
+/*
+ * mem_unmap - give a mapping from mem_map back to the system
+ */
+void mem_unmap(void *start)
+{
+    mem_mapping_t **link, *m;
+
+    MAPS_LOCK();
+    for (link = &mappings; (m = *link) != NULL && m->start != start; link = &m->next)
+        ;
+    if (m != NULL) {
+        *link = m->next;
+        mapped_bytes -= m->size;
+    }
+    MAPS_UNLOCK();
+    if (m == NULL) {
+        fprintf(stderr, "ERROR: mem_unmap failed. %p is not a mapping...\n", start);
+        return;
+    }
+    munmap(m->start, m->size);
+    free(m);
+}
+
+/*
+ * mem_remap - grow or shrink a mapping from mem_map to size bytes, rounded
+ *    up to whole pages. The system moves the pages instead of copying
+ *    them when the mapping can't grow where it is. Returns the new start,
+ *    or NULL and leaves the mapping as it was
+ */
+void *mem_remap(void *start, size_t size)
+{
+    mem_mapping_t *m;
+    size_t page = mem_pagesize();
+    void *moved;
+
+    size = (size + page - 1) & ~(page - 1);
+    MAPS_LOCK();
+    for (m = mappings; m != NULL && m->start != start; m = m->next)
+        ;
+    MAPS_UNLOCK();
+    if (m == NULL) {
+        fprintf(stderr, "ERROR: mem_remap failed. %p is not a mapping...\n", start);
+        return NULL;
+    }
+    if ((moved = mremap(m->start, m->size, size, MREMAP_MAYMOVE)) == MAP_FAILED)
+        return NULL;
+    MAPS_LOCK();
+    mapped_bytes += size - m->size;
+    m->start = moved;
+    m->size = size;
+    update_peak();
+    MAPS_UNLOCK();
+    return moved;
+}
+
+/*
+ * mem_is_mapped - true iff lo to hi lies inside one mapping from mem_map
+ */
+int mem_is_mapped(void *lo, void *hi)
+{
+    mem_mapping_t *m;
+    int found = 0;
+
+    MAPS_LOCK();
+    for (m = mappings; m != NULL && !found; m = m->next)
+        found = (char *)lo >= m->start && (char *)hi < m->start + m->size;
+    MAPS_UNLOCK();
+    return found;
+}
+
+/*
+ * mem_in_region - true iff lo to hi lies below the brk of one region
+ *    from mem_region_create
+ */
+int mem_in_region(void *lo, void *hi)
+{
+    mem_region_t *r;
+    int found = 0;
+
+    MAPS_LOCK();
+    for (r = regions; r != NULL && !found; r = r->next)
+        found = (char *)lo >= r->start_brk && (char *)hi < r->brk;
+    MAPS_UNLOCK();
+    return found;
+}
+
+/*
+ * reserve - address space for size bytes that holds no memory yet, at a
+ *    multiple of align when it isn't 0. Returns NULL when there is none
+ */
+static char *reserve(size_t size, size_t align)
+{
+    char *start, *aligned;
+    size_t extra = align; /* room to slide up to the boundary */
+
+    start = mmap(NULL, size + extra, PROT_NONE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (start == MAP_FAILED)
+        return NULL;
+    if (align) { /* cut off what lies outside the aligned part */
+        aligned = (char *)(((size_t)start + align - 1) & ~(align - 1));
+        if (aligned > start)
+            munmap(start, aligned - start);
+        if (aligned + size < start + size + extra)
+            munmap(aligned + size, start + size + extra - (aligned + size));
+        start = aligned;
+    }
+#ifdef MADV_HUGEPAGE
+    if (hugepages)
+        madvise(start, size, MADV_HUGEPAGE);
+#endif
+    return start;
+}
+
+/*
+ * commit - make the pages of a region usable up to at least end, a unit
+ *    at a time. Returns -1 when the system won't back them
+ */
+static int commit(mem_region_t *r, char *end)
+{
+    size_t unit = hugepages ? HUGE_PAGE : COMMIT_UNIT;
+    char *to = (char *)(((size_t)end + unit - 1) & ~(unit - 1));
+
+    if (to > r->max_addr)
+        to = r->max_addr;
+    if (mprotect(r->commit, to - r->commit, PROT_READ | PROT_WRITE) < 0)
+        return -1;
+    r->commit = to;
+    return 0;
+}
+
+/*
+ * update_peak - raise the peak to what the heap, the other regions and
+ *    the mappings hold now, the caller holds the maps lock
+ */
+static void update_peak(void)
+{
+    size_t bytes = (size_t)(heap.brk - heap.start_brk) + region_bytes + mapped_bytes;
+
+    if (bytes > peak_bytes)
+        peak_bytes = bytes;
+}
+
+/*
+ * mem_region_lo, mem_region_hi - first and last byte of a region's heap
+ */
+void *mem_region_lo(mem_region_t *r)
+{
+    return (void *)r->start_brk;
+}
+
+void *mem_region_hi(mem_region_t *r)
+{
+    return (void *)(r->brk - 1);
+}
+
+/*
+ * mem_region_left - bytes the region can still grow by
+ */
+size_t mem_region_left(mem_region_t *r)
+{
+    return (size_t)(r->max_addr - r->brk);
+}
@@ -1,11 +1,34 @@
 #include <unistd.h>
+#include <stdint.h>
 
+void mem_configure(size_t max_bytes, int huge);
 void mem_init(void);               
 void mem_deinit(void);
-void *mem_sbrk(int incr);
+void *mem_sbrk(intptr_t incr);
 void mem_reset_brk(void); 
 void *mem_heap_lo(void);
 void *mem_heap_hi(void);
 size_t mem_heapsize(void);
+size_t mem_peak_heapsize(void);
+size_t mem_max_heapsize(void);
 size_t mem_pagesize(void);
+void mem_release(void *start, size_t size);
 
+/* mappings of their own, outside every heap */
+void *mem_map(size_t size);
+void mem_unmap(void *start);
+void *mem_remap(void *start, size_t size);
+int mem_is_mapped(void *lo, void *hi);
+
+
+/* independent simulated heaps, each with its own brk */
+typedef struct mem_region mem_region_t;
+
+mem_region_t *mem_heap_region(void);
+mem_region_t *mem_region_create(size_t size);
+void mem_region_destroy(mem_region_t *r);
+void *mem_region_sbrk(mem_region_t *r, intptr_t incr);
+void *mem_region_lo(mem_region_t *r);
+void *mem_region_hi(mem_region_t *r);
+size_t mem_region_left(mem_region_t *r);
+int mem_in_region(void *lo, void *hi);
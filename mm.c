@@ -1,30 +1,63 @@
 /*
- * Our solution uses an explisit doubly linked list for free blocks and best-fit find with a threshold 
- * so the find fit function doesn't have to traverse the whole list if it already found a free block with minimum waste.
- * the LISTHEAD pointer is the head of the free list and is located after the padding in the heap.
- * we also modified the CHUNKSIZE wich is the minimum size added to the head when extended
- * 
- * * Each block has header and footer of the form:
- * 
- *      31                     3  2  1  0 
- *      -----------------------------------
- *     | s  s  s  s  ... s  s  s  0  0  a/f
- *      ----------------------------------- 
- * 
- * where s are the meaningful size bits and a/f is set 
- * iff the block is allocated. The list has the following form:
+ * Our solution uses segregated explicit free lists and best-fit find with a threshold, so find_fit doesn't have
+ * to traverse a whole list when it already found a free block with little waste.
+ *
+ * Heaps and arenas. Every heap is an arena in a memlib region of its own. The arena header at the start of the
+ * region holds the free block index and the slabs, then come the padding, the prologue, the blocks and the
+ * epilogue. mm_init lays the default arena out in the memlib heap and mm_malloc and friends use it,
+ * mm_arena_create makes more. mm_malloc_hint puts the blocks hinted SHORT_LIVED in an arena of their own so the
+ * holes they leave don't end up between the long lived ones. mm_region_alloc bumps a pointer through chunks a
+ * region takes from mm_malloc, and mm_region_reset frees them all with one mm_free per chunk.
+ *
+ * Blocks. A word is a size_t, 8 bytes on LP64, and payloads are 16 byte aligned (4 and 8 in mdriver-m32). Each
+ * block has a header and free blocks also have a footer of the form:
+ *
+ *      63                                 3  2  1  0
+ *      ----------------------------------------------
+ *     | s  s  s  s  s  ...  s  s  s  s  s  g  p  a/f |
+ *      ----------------------------------------------
+ *
+ * where s are the size bits, a/f is set iff the block is allocated and p is set iff the block before it is
+ * allocated, so allocated blocks need no footer. g is set on allocated blocks that realloc has grown: such a block
+ * keeps spare room at its end, half its size up to REALLOC_SLACK bytes, whether it grew in place or had to move,
+ * so a buffer grown in small steps is only copied now and then. The heap looks like this:
+ *
+ * begin                                                                      end
+ * heap                                                                       heap
+ *  --------------------------------------------------------------------------
+ * | struct arena |  pad   | hdr(16:a) | ftr(16:a) | zero or more | hdr(0:a) |
+ *  --------------------------------------------------------------------------
+ * | free index,  |        |        prologue       |   usr blks   | epilogue |
+ * | slabs        |        |          block        |              | block    |
  *
- * begin                                                                       end
- * heap                                                                        heap  
- *  ------------------------------------------------------------------------------   
- * |  pad   |   LISTHEAD | hdr(8:a) | ftr(8:a) | zero or more usr blks | hdr(8:a) |
- *  ------------------------------------------------------------------------------
- *          |   *prev    |       prologue      |                       | epilogue |
- *          |   *next    |         block       |                       | block    |
+ * The allocated prologue and epilogue blocks are overhead that eliminate edge conditions during coalescing.
  *
- * The allocated prologue and epilogue blocks are overhead that
- * eliminate edge conditions during coalescing.
+ * Free blocks. The links in a free block are 32 bit offsets from the start of its arena, so they take 8 bytes
+ * as long as the arena stays under 32GB. By default the free blocks are in NUM_CLASSES doubly linked lists, one
+ * per power of two size class, and find_fit starts at the smallest class that can hold the request. The threshold
+ * and the smallest remainder place splits off follow the sizes of the recent requests. -DFIT_POLICY=FIRST_FIT,
+ * NEXT_FIT, ADDRESS_FIT or BEST_FIT (make policies) picks the fit in a class differently, ADDRESS_FIT keeps the
+ * lists in address order as skip lists. -DFREE_INDEX=TLSF (make mdriver-tlsf) swaps the classes for a two level
+ * segregated fit index with bitmaps, and -DFREE_INDEX=TREE (make mdriver-tree) for a treap ordered by size and
+ * address. -DSPLIT_PLACE=SMALL_BACK or SMALL_FRONT cuts the small or the big requests from the back of a free
+ * block, so blocks of different sizes, and usually lifetimes, don't interleave.
+ *
+ * Small and big requests. Requests of at most SLAB_MAX bytes take a slot in a slab, a page aligned block cut in to
+ * slots of one size with a bitmap of the free ones, found again through the slab registry. Requests of
+ * MMAP_THRESHOLD bytes or more get a memlib mapping of their own that realloc resizes with mremap; the word before
+ * such a payload holds the mapping size with a/f clear and g set, which no block in use has. When a free block at
+ * the top of the heap reaches TRIM_THRESHOLD bytes it goes back to memlib, and empty slabs go with it.
+ *
+ * Threads. -DMM_THREADS (make mtdriver) guards each arena with a lock and gives every thread a cache of the small
+ * blocks it freed, TCACHE_COUNT per size, and an arena of its own. A block freed by a thread that doesn't own its
+ * arena goes on the arena's remote free queue, which the owner frees in one batch on its next malloc, or straight
+ * in to the arena under its lock with -DREMOTE_FREE=0 (make mtdriver-locked). -DPER_CPU (make mtdriver-percpu)
+ * gives every cpu an arena instead and drops the caches. -DSCAVENGE (make mtdriver-scavenge) starts a thread that
+ * every SCAVENGE_MS gives back the pages inside free blocks nobody touched for SCAVENGE_DECAY of its rounds.
  */
+#ifdef PER_CPU
+#define _GNU_SOURCE /* for sched_getcpu */
+#endif
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
@@ -34,6 +67,13 @@
 #include "mm.h"
 #include "memlib.h"
 
+#ifdef MM_THREADS
+#include <pthread.h>
+#endif
+#ifdef PER_CPU
+#include <sched.h>
+#endif
+
 /*********************************************************
  * NOTE TO STUDENTS: Before you do anything else, please
  * provide your team information in below _AND_ in the
@@ -89,61 +129,498 @@ team_t team = {
 #endif
 
 /* $begin mallocmacros */
-/* single word (4) or double word (8) alignment */
-#define ALIGNMENT 8
-
-/* rounds up to the nearest multiple of ALIGNMENT */
-#define ALIGN(size) (((size) + OVERHEAD + (ALIGNMENT - 1)) & ~0x7)
-
-/* Basic constants and macros */
+/* Basic constants and macros. A word holds a size_t, so it is 8 bytes on LP64 and 4 on 32 bit */
+#ifdef __LP64__
+#define WSIZE 8            /* word size (bytes) */
+#else
 #define WSIZE 4            /* word size (bytes) */
-#define DSIZE 8            /* doubleword size (bytes) */
+#endif
+#define DSIZE (2 * WSIZE)  /* doubleword size (bytes) */
 #define CHUNKSIZE (1 << 8) /* initial heap size (bytes) */
-#define OVERHEAD 8         /* overhead of header and footer (bytes) */
+#define OVERHEAD DSIZE     /* overhead of header and footer of a free block (bytes) */
+
+/* payloads are double word aligned, 16 bytes on x86-64 as the ABI asks of malloc */
+#define ALIGNMENT DSIZE
+
+/* adds the header and rounds up to the nearest multiple of ALIGNMENT, but never below the minimum block size */
+#define ALIGN(size) MAX(MIN_BLOCK, ((size) + WSIZE + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
+
+/* a free block must have room for its header, the free list links and its footer */
+#define MIN_BLOCK ((WSIZE + sizeof(struct freeNode) + WSIZE + (ALIGNMENT - 1)) & ~(ALIGNMENT - 1))
 
 #define MAX(x, y) ((x) > (y) ? (x) : (y))
+#define MIN(x, y) ((x) < (y) ? (x) : (y))
 
 /* Pack a size and allocated bit into a word */
 #define PACK(size, alloc) ((size) | (alloc))
 
-/* Read and write a word at address p */
+/* Read and write a word at address p. With threads the free path reads the header of its own block */
+/* without the arena lock while the owner sets or clears its p bit, so every word goes through relaxed */
+/* atomics, which are still plain loads and stores on x86-64 */
+#ifdef MM_THREADS
+#define GET(p) __atomic_load_n((size_t *)(p), __ATOMIC_RELAXED)
+#define PUT(p, val) __atomic_store_n((size_t *)(p), (val), __ATOMIC_RELAXED)
+#else
 #define GET(p) (*(size_t *)(p))
 #define PUT(p, val) (*(size_t *)(p) = (val))
+#endif
 
 /* Read the size and allocated fields from address p */
 #define GET_SIZE(p) (GET(p) & ~0x7)
 #define GET_ALLOC(p) (GET(p) & 0x1)
 
-/* Given block ptr bp, compute address of its header and footer */
+/* Read, set and clear the allocated bit of the previous block at address p */
+#define PREV_ALLOC 0x2
+#define GET_PREV_ALLOC(p) (GET(p) & PREV_ALLOC)
+#define SET_PREV_ALLOC(p) PUT(p, GET(p) | PREV_ALLOC)
+#define CLEAR_PREV_ALLOC(p) PUT(p, GET(p) & ~PREV_ALLOC)
+
+/* Read and set the grown bit of an allocated block at address p, rewriting the header clears it */
+#define GROWN 0x4
+#define GET_GROWN(p) (GET(p) & GROWN)
+#define SET_GROWN(p) PUT(p, GET(p) | GROWN)
+
+/* Given block ptr bp, compute address of its header and footer, only free blocks have a footer */
 #define HDRP(bp) ((char *)(bp)-WSIZE)
 #define FTRP(bp) ((char *)(bp) + GET_SIZE(HDRP(bp)) - DSIZE)
 
-/* Given block ptr bp, compute address of next and previous blocks */
+/* Given block ptr bp, compute address of next and previous blocks, the previous one only if it is free */
 #define NEXT_BLKP(bp) ((char *)(bp) + GET_SIZE(((char *)(bp)-WSIZE)))
 #define PREV_BLKP(bp) ((char *)(bp)-GET_SIZE(((char *)(bp)-DSIZE)))
 
-/* Get head of the free list*/
-#define LISTHEAD ((listNode)(heap_listp - WSIZE - DSIZE))
+/* index of the most and least significant set bit, these compile to bsr and bsf */
+#define FLS(x) ((int)(sizeof(unsigned long) * 8 - 1) - __builtin_clzl(x))
+#define FFS(x) __builtin_ctz(x)
+
 /* $end mallocmacros */
 
-/* Node for the free node list */
+/* most spare room realloc gives a block that keeps growing, moved or in place, 0 turns the spare room off */
+#ifndef REALLOC_SLACK
+#define REALLOC_SLACK (64 * 1024)
+#endif
+
+/* a free block at the top of the heap of at least TRIM_THRESHOLD bytes goes back to memlib, 0 never trims */
+#ifndef TRIM_THRESHOLD
+#define TRIM_THRESHOLD (128 * 1024)
+#endif
+
+/* the heap grows by at least extend_min bytes, CHUNKSIZE unless mm_set_extend says otherwise, and every */
+/* extension in a row doubles the next one up to extend_max while frees halve it again */
+#ifndef EXTEND_MAX
+#define EXTEND_MAX 4096
+#endif
+
+/* The fit slack and the split threshold follow the sizes of recent requests, a histogram with a bucket */
+/* per power of two that is read and halved every SIZE_WINDOW requests. place only splits off a remainder */
+/* at least as big as SPLIT_PCT percent of the requests, anything smaller would wait long for a request */
+/* it fits, and find_fit stops at a remainder of up to SLACK_PCT percent of them */
+#ifndef SPLIT_PCT
+#define SPLIT_PCT 5
+#endif
+#ifndef SLACK_PCT
+#define SLACK_PCT 10
+#endif
+#define SIZE_WINDOW 128 /* with the halving no count gets past 255, so a byte holds it */
+#define SMALL_PCT 50    /* a request is small if it's below the size this percent of the requests fall under */
+#define SIZE_BUCKETS 32  /* the arena header counts against utilization, 2GB and up share the last bucket */
+
+/* Which end of a free block place cuts a request from when it splits, chosen at build time with */
+/* -DSPLIT_PLACE=... Cutting small and big requests from opposite ends keeps them in separate runs of */
+/* blocks, so when the short lived ones of one size go they coalesce with each other instead of leaving */
+/* holes between the long lived ones of the other. The top block of the heap is cut the same way, that is */
+/* where a growing heap hands out most of its blocks */
+#define FRONT 0       /* every request from the front, the tail goes back to the free lists */
+#define SMALL_BACK 1  /* small requests from the back and big ones from the front */
+#define SMALL_FRONT 2 /* small requests from the front and big ones from the back */
+
+#ifndef SPLIT_PLACE
+#define SPLIT_PLACE FRONT
+#endif
+
+/* Requests of at least MMAP_THRESHOLD bytes get a mapping of their own, 0 never maps */
+#ifndef MMAP_THRESHOLD
+#define MMAP_THRESHOLD (128 * 1024)
+#endif
+#define MAPPED GROWN                                    /* with the alloc bit clear, the chunk is a mapping */
+#define CHUNK_HDR MAX(ALIGNMENT, WSIZE)                 /* bytes before the payload of a mapped chunk */
+#define MAP_PAGE 4096                                   /* mappings start on a boundary of at least this */
+
+/* Given a payload pointer, true iff it is a mapped chunk. A slab slot has no header, so the word */
+/* before it is user data and memlib has the final say. mm_free asks before it takes any lock, the */
+/* header of a heap block can have its p bit flipped meanwhile, so the read goes through the atomic GET */
+#define IS_MAPPED(bp) (((size_t)(bp) & (MAP_PAGE - 1)) == CHUNK_HDR && \
+                       (GET(HDRP(bp)) & (MAPPED | 0x1)) == MAPPED && mem_is_mapped(bp, bp))
+
+/* The scavenger gives back the pages of free blocks that stay untouched, see scavenge */
+#ifdef SCAVENGE
+#ifndef MM_THREADS
+#error "the scavenger is a thread of its own, build with -DMM_THREADS as well"
+#endif
+#ifndef SCAVENGE_MS
+#define SCAVENGE_MS 100                 /* how often the scavenger wakes up */
+#endif
+#ifndef SCAVENGE_DECAY
+#define SCAVENGE_DECAY 10               /* rounds a free block sits untouched before its pages go back */
+#endif
+#define SCAVENGE_MIN (16 * 1024)        /* smaller free blocks hold a page or two at most */
+#define RELEASED ((size_t)-1)           /* stamp of a block that has no pages left to give */
+#define STAMPP(bp) (FTRP(bp) - WSIZE)   /* the round a free block was freed in sits before its footer */
+#define STAMP(bp) (GET_SIZE(HDRP(bp)) >= SCAVENGE_MIN ? PUT(STAMPP(bp), __atomic_load_n(&scavenge_round, __ATOMIC_RELAXED)) : 0)
+#else
+#define STAMP(bp)
+#endif
+
+/* spare room for a block of asize bytes that realloc grew before */
+#define SPARE(asize) (MIN((asize) / 2, REALLOC_SLACK) & ~(ALIGNMENT - 1))
+
+/* Free block index, chosen at build time with -DFREE_INDEX=... (see the Makefile) */
+#define SEGLIST 0 /* power of two size classes, best fit with a threshold inside a class */
+#define TLSF 1    /* two level segregated fit, bitmaps find a non empty list in O(1) */
+#define TREE 2    /* treap ordered by size, exact best fit in O(log n) */
+
+#ifndef FREE_INDEX
+#define FREE_INDEX SEGLIST
+#endif
+
+/* Placement policy of the segregated lists, chosen at build time with -DFIT_POLICY=... */
+#define FIRST_FIT 0   /* the first block that fits, starting at the class of the request */
+#define NEXT_FIT 1    /* first fit, but every class resumes where its last search stopped */
+#define ADDRESS_FIT 2 /* first fit over lists kept in address order, the lowest block that fits */
+#define GOOD_FIT 3    /* best fit that settles for a remainder no bigger than the fit slack */
+#define BEST_FIT 4    /* the smallest block that fits, the whole class is searched */
+
+#ifndef FIT_POLICY
+#define FIT_POLICY GOOD_FIT
+#endif
+#if FIT_POLICY != GOOD_FIT && FREE_INDEX != SEGLIST
+#error "FIT_POLICY only applies to the segregated lists, TLSF and the tree have a placement of their own"
+#endif
+
+#if FREE_INDEX == TLSF
+/* The first level splits sizes by powers of two and each first level is split again in to SL_COUNT */
+/* second level lists. Sizes below SMALL_BLOCK all share first level 0 where the lists step by ALIGNMENT */
+#define SL_SHIFT 3
+#define SL_COUNT (1 << SL_SHIFT)
+#define ALIGN_SHIFT (ALIGNMENT == 16 ? 4 : 3)
+#define FL_SHIFT (SL_SHIFT + ALIGN_SHIFT)
+#define SMALL_BLOCK (1 << FL_SHIFT)
+#define FL_MAX 30 /* blocks of 2^FL_MAX bytes or more all end up in the last list */
+#define FL_COUNT (FL_MAX - FL_SHIFT + 1)
+#define NUM_LISTS (FL_COUNT * SL_COUNT)
+#elif FREE_INDEX == TREE
+/* Blocks of equal size are ordered by address, so every block has a unique key and a free */
+/* block only needs room for the two child links. The heap priority is a hash of the address */
+#define TREE_LESS(a, b) (GET_SIZE(HDRP(a)) < GET_SIZE(HDRP(b)) || \
+                         (GET_SIZE(HDRP(a)) == GET_SIZE(HDRP(b)) && (char *)(a) < (char *)(b)))
+#define PRIORITY(bp) ((unsigned int)((size_t)(bp) >> 3) * 2654435761U)
+#else
+/* Segregated free lists, class i holds blocks of size [2^(i+4), 2^(i+5)) and the last class everything bigger */
+#define NUM_CLASSES 16
+#define CLASS_SHIFT 4
+#define NUM_LISTS NUM_CLASSES
+#endif
+
+/* Free blocks link to each other with 32 bit offsets from the start of their arena in LINK_SHIFT */
+/* units, so the links take 8 bytes on LP64 as well and an arena can span 32GB. Offset 0 is NULL, */
+/* it is the arena header and never a free block */
+typedef unsigned int link_t;
+#define LINK_SHIFT 3
+#define LINK_SPAN ((unsigned long long)1 << (32 + LINK_SHIFT)) /* most bytes an arena can span */
+#define TO_LINK(a, p) ((p) == NULL ? 0 : (link_t)(((char *)(p) - (char *)(a)) >> LINK_SHIFT))
+#define FROM_LINK(a, l) ((l) == 0 ? NULL : (void *)((char *)(a) + ((size_t)(l) << LINK_SHIFT)))
+
+/* Get head of free list i, the heads only store the next link so */
+/* the prev field of a head must never be touched */
+#define LISTHEAD(a, i) ((a)->findex.lists + (i))
+
+/* Node for the free node list, aligned so the heads in the arena header have an offset too */
 typedef struct freeNode *listNode;
 struct freeNode
 {
-    listNode next;
-    listNode prev;
+    link_t next;
+    link_t prev;
+} __attribute__((aligned(1 << LINK_SHIFT)));
+
+/* Node for the free block tree, same size as a list node */
+typedef struct treeNode *treeNode;
+struct treeNode
+{
+    link_t left;
+    link_t right;
+};
+
+/* Follow the links of a node in arena a */
+#define NEXT(a, n) ((listNode)FROM_LINK(a, (n)->next))
+#define PREV(a, n) ((listNode)FROM_LINK(a, (n)->prev))
+#define LEFT(a, n) ((treeNode)FROM_LINK(a, (n)->left))
+#define RIGHT(a, n) ((treeNode)FROM_LINK(a, (n)->right))
+
+#if FIT_POLICY == ADDRESS_FIT
+/* The address ordered lists are skip lists, so a free block finds its place without walking the */
+/* whole class. Above the list links a free block has a tower of up to SKIP_LEVELS express links, */
+/* one more level for every two zero bits of a hash of its address and as many as fit in the block. */
+/* A quarter of the blocks on each level go up, so log4 of the most free blocks the heap can hold */
+/* levels keep a search logarithmic. Every level costs each arena a head per class, so the count */
+/* follows MAX_HEAP, the heap memlib reserves (config.h), instead of the most an arena can span */
+#ifndef MAX_HEAP
+#define MAX_HEAP (20 * (1 << 20))
+#endif
+#define SKIP_BLOCKS ((unsigned long long)(MAX_HEAP) / 32) /* free blocks in a heap of the smallest ones */
+#ifndef SKIP_LEVELS
+#define SKIP_LEVELS (4 + (SKIP_BLOCKS > 1ULL << 8) + (SKIP_BLOCKS > 1ULL << 10) + (SKIP_BLOCKS > 1ULL << 12) + \
+                     (SKIP_BLOCKS > 1ULL << 14) + (SKIP_BLOCKS > 1ULL << 16) + (SKIP_BLOCKS > 1ULL << 18) + \
+                     (SKIP_BLOCKS > 1ULL << 20) + (SKIP_BLOCKS > 1ULL << 22) + (SKIP_BLOCKS > 1ULL << 24) + \
+                     (SKIP_BLOCKS > 1ULL << 26) + (SKIP_BLOCKS > 1ULL << 28) + (SKIP_BLOCKS > 1ULL << 30))
+#endif
+#define SKIP(bp) ((link_t *)((char *)(bp) + sizeof(struct freeNode))) /* SKIP(bp)[i] is the link on level i + 1 */
+#define FREE_LINKS (sizeof(struct freeNode) + SKIP_LEVELS * sizeof(link_t))
+#else
+#define FREE_LINKS sizeof(struct freeNode) /* bytes of links at the start of a free payload */
+#endif
+
+/* The free block index of an arena */
+typedef struct
+{
+#if FREE_INDEX == TLSF
+    unsigned int fl_bitmap;            /* bit f is set iff some list in first level f is non empty */
+    unsigned char sl_bitmap[FL_COUNT]; /* bit s of sl_bitmap[f] is set iff list f * SL_COUNT + s is non empty */
+#endif
+#if FREE_INDEX == TREE
+    link_t root; /* root of the treap of free blocks */
+#else
+    struct freeNode lists[NUM_LISTS]; /* free list heads */
+#endif
+#if FIT_POLICY == NEXT_FIT
+    link_t rover[NUM_CLASSES]; /* where the next search of each class starts, 0 for the head */
+#endif
+#if FIT_POLICY == ADDRESS_FIT
+    link_t skip[NUM_CLASSES][SKIP_LEVELS]; /* express link heads of each class */
+#endif
+} freeIndex;
+
+/* Small requests are served from slabs, SLAB_SIZE aligned blocks cut in to slots of one size */
+/* with a bitmap of the free slots. Building with -DSLAB_MAX=0 turns them off */
+#ifndef SLAB_MAX
+#ifdef MM_THREADS
+#define SLAB_MAX 0                                   /* the thread caches take the small objects, and telling */
+#else                                                /* a slot from a block needs the lock */
+#define SLAB_MAX 64                                  /* biggest request that goes to a slab (bytes) */
+#endif
+#endif
+#if defined(MM_THREADS) && SLAB_MAX != 0
+#error "the thread safe build has no slabs, SLAB_MAX must be 0"
+#endif
+#if SLAB_MAX % ALIGNMENT != 0
+#error "SLAB_MAX must be a multiple of ALIGNMENT, every slot size is"
+#endif
+#define SLAB_SIZE 4096                               /* one page, slabs are aligned to it */
+#define SLAB_CLASSES (SLAB_MAX / ALIGNMENT)          /* slot sizes go up in steps of ALIGNMENT */
+#define SLAB_WORDS (SLAB_SIZE / ALIGNMENT / 32)      /* bitmap words for the most slots a slab can have */
+#define SLAB_HDR ((sizeof(struct slab) + ALIGNMENT - 1) & ~(ALIGNMENT - 1))
+
+/* Given a pointer in to a slab, compute the address of the slab */
+#define SLABP(ptr) ((slab)((size_t)(ptr) & ~(size_t)(SLAB_SIZE - 1)))
+
+/* Header at the start of every slab */
+typedef struct slab *slab;
+struct slab
+{
+    unsigned int id;                 /* index of the slab in the registry */
+    unsigned short slotSize;         /* bytes in each slot */
+    unsigned short slots;            /* number of slots */
+    unsigned short freeSlots;        /* number of free slots */
+    slab next;                       /* slabs of the same slot size with free slots */
+    slab prev;
+    unsigned int summary;            /* bit w is set iff bitmap[w] has a free slot */
+    unsigned int bitmap[SLAB_WORDS]; /* bit i is set iff slot i is free */
+};
+
+/* The slabs of an arena. A pointer is in a slab iff the */
+/* page it is on starts with an id that the registry maps back to that same page, */
+/* user data on a page that isn't a slab can never pass that check */
+typedef struct
+{
+    slab partial[SLAB_CLASSES + 1]; /* slabs with free slots for each slot size */
+    slab *registry;                 /* every slab, the registry itself is a normal block */
+    unsigned int count;             /* slabs in the registry */
+    unsigned int capacity;          /* room in the registry */
+} slabIndex;
+
+#ifdef MM_THREADS
+/* Each thread keeps the blocks it frees of up to TCACHE_MAX bytes in a list per size, linked */
+/* through the payload, and hands them back to the heap when it exits */
+#define TCACHE_MAX 512                        /* biggest block kept in a thread cache (bytes) */
+#define TCACHE_CLASSES (TCACHE_MAX / ALIGNMENT) /* one list for every block size up to TCACHE_MAX */
+#ifdef PER_CPU
+#define TCACHE_COUNT 0                        /* the cpu arenas do the caching */
+#else
+#define TCACHE_COUNT 32                       /* most blocks kept in one list */
+#endif
+
+typedef struct threadCache threadCache;
+struct threadCache
+{
+    void *head[TCACHE_CLASSES + 1];         /* cached blocks of each size */
+    unsigned int count[TCACHE_CLASSES + 1]; /* and how many there are */
+    size_t bytes;                           /* all the cached blocks together */
+    int registered;                         /* on the caches list with an exit handler */
+    threadCache *next;                      /* the next thread's cache */
+};
+
+#ifndef REMOTE_FREE
+#define REMOTE_FREE 1 /* blocks freed by other threads go through the owner's queue */
+#endif
+
+static __thread threadCache tcache;                 /* this thread's cache */
+static __thread arena_t thread_arena;               /* the arena this thread allocates from */
+static pthread_key_t tcache_key;                    /* runs thread_exit when a thread exits */
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+static arena_t thread_arenas;                       /* every thread arena, owned or not, new ones go in front */
+static threadCache *caches;                         /* the cache of every live thread, for mm_stats */
+static pthread_mutex_t arenas_lock = PTHREAD_MUTEX_INITIALIZER; /* guards thread_arenas and caches */
+#ifdef SCAVENGE
+static pthread_once_t scavenge_once = PTHREAD_ONCE_INIT;
+static size_t scavenge_round;                       /* rounds the scavenger has made */
+static pthread_mutex_t scavenge_lock = PTHREAD_MUTEX_INITIALIZER; /* keeps mm_init from destroying the arenas of a round */
+#endif
+
+#ifdef PER_CPU
+#define MAX_CPUS 256                        /* cpus beyond this share arenas */
+static arena_t cpu_arenas[MAX_CPUS];        /* created the first time something runs on the cpu */
+#endif
+
+#define LOCK(a) pthread_mutex_lock(&(a)->lock)
+#define UNLOCK(a) pthread_mutex_unlock(&(a)->lock)
+#else
+#define LOCK(a)
+#define UNLOCK(a)
+#endif
+
+/* An arena is a heap of its own in its own memlib region. The region starts with this */
+/* header, followed by the padding, the prologue, the blocks and the epilogue */
+struct arena
+{
+    mem_region_t *region; /* where the heap lives */
+    char *heap_listp;     /* pointer to first block */
+    freeIndex findex;     /* the free lists */
+    slabIndex slabs;      /* the slabs */
+    size_t reallocMoves;  /* reallocs that copied the block somewhere else */
+    size_t reallocStays;  /* reallocs that kept the block where it was */
+    size_t movedBytes;    /* bytes the moves copied */
+    size_t savedBytes;    /* bytes the blocks that stayed would have needed copied */
+    size_t extendSize;    /* least the heap grows by the next time nothing fits */
+    size_t sbrkCalls;     /* times the heap grew */
+    size_t sbrkBytes;     /* bytes it grew by */
+    unsigned char sizeHist[SIZE_BUCKETS]; /* recent block requests by power of two, decaying */
+    unsigned int sizeCount; /* requests since the thresholds were last worked out */
+    size_t splitMin;      /* smallest remainder place splits off */
+    size_t fitSlack;      /* remainder find_fit settles for without looking further */
+    size_t smallCut;      /* requests below it count as small for SPLIT_PLACE */
+#ifdef MM_THREADS
+    pthread_mutex_t lock; /* guards the arena and its region */
+    void *remote;         /* blocks freed by other threads, linked through the payload */
+    int owned;            /* set while a thread allocates from this arena */
+    arena_t next;         /* the next thread arena */
+#endif
+};
+
+/* size of the arena header rounded up so the prologue stays aligned */
+#define ARENA_SIZE ((sizeof(struct arena) + DSIZE - 1) & ~(DSIZE - 1))
+
+/* Thread arenas and the arena of the short lived blocks live in regions aligned to their size, so the */
+/* arena of a block is its address rounded down, unless the block is in the default arena in the memlib heap. */
+/* mm_init makes that size the smallest power of two that holds what memlib lets the heap grow to, within */
+/* THREAD_ARENA_MIN and THREAD_ARENA_MAX. When an arena fills up anyway its blocks go to the default arena */
+#ifdef PER_CPU
+#define THREAD_ARENA_MIN (1 << 28) /* every thread on a cpu shares its arena, so it starts at 256MB */
+#else
+#define THREAD_ARENA_MIN (1 << 26) /* 64MB */
+#endif
+#define THREAD_ARENA_MAX ((size_t)MIN(LINK_SPAN, (unsigned long long)1 << (sizeof(size_t) * 8 - 4))) /* the links reach no */
+                                                                                                       /* further, and a 32 bit */
+                                                                                                       /* address space is small */
+#define ARENA_OF(ptr) ((char *)(ptr) >= (char *)mem_heap_lo() && (char *)(ptr) <= (char *)mem_heap_hi() ? \
+                       default_arena : (arena_t)((size_t)(ptr) & ~(thread_arena_size - 1)))
+
+/* A region bumps through chunks it takes from mm_malloc, newest first, the first word of every chunk links */
+/* the one taken before it. Chunks double from REGION_CHUNK up to REGION_CHUNK_MAX, which stays in the heap */
+#define REGION_CHUNK (4 * 1024)
+#define REGION_CHUNK_MAX (64 * 1024)
+#define REGION_LINK ((sizeof(char *) + ALIGNMENT - 1) & ~(ALIGNMENT - 1)) /* the link, rounded so payloads stay aligned */
+#define REGION_BIG (REGION_CHUNK_MAX / 4) /* objects this big get a chunk of their own */
+
+struct mm_region
+{
+    char *chunks; /* the chunk being bumped through, NULL before the first alloc */
+    char *next;   /* its next free byte */
+    char *end;    /* first byte past it */
+    size_t grow;  /* bytes the next chunk asks for */
 };
+
 /* Global variables */
-static char *heap_listp; /* pointer to first block */
+static arena_t default_arena; /* the heap mm_malloc and friends work on, in the memlib heap */
+static arena_t short_arena;   /* where the blocks hinted SHORT_LIVED go, made for the first one */
+static size_t thread_arena_size = THREAD_ARENA_MIN; /* bytes a thread or short lived arena can grow to */
+static size_t mapped_bytes;   /* bytes in mapped chunks */
+static size_t extend_min = CHUNKSIZE;  /* smallest step the heap grows by */
+static size_t extend_max = EXTEND_MAX; /* biggest step sustained growth works up to */
 
 /* function prototypes for internal helper routines */
-void removeFromList(void *bp);
-void addToList(void *bp);
-static void freeListChecker();
-static void *extend_heap(size_t words);
-static void place(void *bp, size_t asize);
-static void *find_fit(size_t asize);
-static void *coalesce(void *bp);
+void removeFromList(arena_t a, void *bp);
+void addToList(arena_t a, void *bp);
+#if FREE_INDEX != TREE
+static int list_index(size_t size);
+#endif
+#if FIT_POLICY == ADDRESS_FIT
+static int skip_height(void *bp);
+static listNode skip_find(arena_t a, int index, void *bp, link_t **update);
+#endif
+static int freeListChecker(arena_t a);
+static void *extend_heap(arena_t a, size_t words);
+static size_t extend_size(arena_t a, size_t asize);
+static void size_seen(arena_t a, size_t asize);
+static void place(arena_t a, void *bp, size_t asize);
+static void *place_split(arena_t a, void *bp, size_t asize);
+static void *find_fit(arena_t a, size_t asize);
+static void *coalesce(arena_t a, void *bp);
+static arena_t arena_init(mem_region_t *region);
+static void heap_check(arena_t a, int verbose);
+static void heap_stats(arena_t a, mm_stats_t *stats);
+static void *heap_malloc(arena_t a, size_t size);
+static void heap_free(arena_t a, void *bp);
+static void *heap_realloc(arena_t a, void *ptr, size_t size);
+static void shrink_block(arena_t a, void *bp, size_t asize);
+static void trim_heap(arena_t a, void *bp);
+static void *block_alloc(arena_t a, size_t asize);
+static void *alloc_aligned(arena_t a, size_t asize, size_t align);
+static void *slab_alloc(arena_t a, size_t size);
+static void slab_free(arena_t a, slab s, void *ptr);
+static void slab_release(arena_t a, slab s);
+static void slab_release_empty(arena_t a);
+static slab slab_owner(arena_t a, void *ptr);
+static void slabChecker(arena_t a);
+#ifdef MM_THREADS
+static void *tcache_get(size_t asize);
+static int tcache_put(void *bp);
+static void thread_exit(void *cache);
+static void tcache_key_init(void);
+static void thread_register(void);
+static arena_t my_arena(void);
+static int remote_free(arena_t a, void *bp);
+static void remote_drain(arena_t a);
+#endif
+#ifdef SCAVENGE
+static void scavenger_start(void);
+static void *scavenger(void *arg);
+static void scavenge(arena_t a);
+static size_t free_pages(void *bp, char **lo);
+#endif
+static void *map_alloc(size_t size);
+static void map_free(void *bp);
+static void *map_realloc(void *bp, size_t size);
+static arena_t short_lived_arena(void);
+static void *realloc_default(arena_t a, void *ptr, size_t size);
+static void region_free_chunks(char *chunk);
 static void printblock(void *bp);
 static void checkblock(void *bp);
 
@@ -153,354 +630,1934 @@ static void checkblock(void *bp);
 /* $begin mminit */
 int mm_init(void)
 {
-    /* create the initial empty heap */
-    if ((heap_listp = mem_sbrk(6 * WSIZE)) == NULL)
-    {
-        return -1;
-    }
-    PUT(heap_listp, 0);                               /* alignment padding */
-    listNode head = ((listNode)(heap_listp + WSIZE)); /* pointer extra 8 bytes 1 DSIZE */
-    head->next = NULL;
-    head->prev = NULL;
-    PUT(heap_listp + DSIZE + WSIZE, PACK(OVERHEAD, 1));  /* prologue header */
-    PUT(heap_listp + DSIZE + DSIZE, PACK(OVERHEAD, 1));  /* prologue footer */
-    PUT(heap_listp + DSIZE + DSIZE + WSIZE, PACK(0, 1)); /* epilogue header */
-    heap_listp += (DSIZE + DSIZE);
+#ifdef SCAVENGE
+    pthread_once(&scavenge_once, scavenger_start);
+    pthread_mutex_lock(&scavenge_lock); /* the scavenger can't walk the arenas while they are laid out again */
+#endif
+#ifdef MM_THREADS
+    arena_t a;
 
-    /* Extend the empty heap with a free block of CHUNKSIZE bytes */
-    if (extend_heap(CHUNKSIZE / WSIZE) == NULL)
-    {
-        return -1;
+    memset(&tcache, 0, sizeof(tcache)); /* whatever was cached belonged to the old heap */
+    caches = NULL;
+    thread_arena = NULL;
+    while ((a = thread_arenas) != NULL)
+    { /* and so did the thread arenas, the short lived arena among them */
+        thread_arenas = a->next;
+        mem_region_destroy(a->region);
     }
-
-    return 0;
+#ifdef PER_CPU
+    memset(cpu_arenas, 0, sizeof(cpu_arenas));
+#endif
+#else
+    mm_arena_destroy(short_arena); /* and so did the short lived blocks */
+#endif
+    short_arena = NULL;
+    for (thread_arena_size = THREAD_ARENA_MIN;
+         thread_arena_size < mem_max_heapsize() && thread_arena_size < THREAD_ARENA_MAX; thread_arena_size *= 2)
+        ; /* the arenas made from now on can hold as much as the heap */
+    /* the default arena takes over the whole memlib heap */
+    default_arena = arena_init(mem_heap_region());
+#ifdef SCAVENGE
+    pthread_mutex_unlock(&scavenge_lock);
+#endif
+    return default_arena == NULL ? -1 : 0;
 }
 /* $end mminit */
 
 /* 
- * mm_malloc - Allocate a block with at least size bytes of payload 
+ * arena_init - Lay out an empty arena at the start of region
  */
-/* $begin mmmalloc */
-void *mm_malloc(size_t size)
+static arena_t arena_init(mem_region_t *region)
 {
-    CHECKHEAP(1);      /* lets us know each time he goes in the mm_malloc function when checking the heap */
-    size_t asize;      /* adjusted block size */
-    size_t extendsize; /* amount to extend heap if no fit */
+    arena_t a;
     char *bp;
 
-    /* Ignore spurious requests */
-    if (size <= 0)
+    /* create the initial empty heap, the arena header comes first */
+    if ((a = mem_region_sbrk(region, ARENA_SIZE + 4 * WSIZE)) == (void *)-1)
     {
         return NULL;
     }
+    memset(a, 0, sizeof(struct arena)); /* every list starts out empty and there are no slabs */
+    a->region = region;
+    a->extendSize = extend_min;
+    a->splitMin = MIN_BLOCK; /* until there are requests to go by */
+    a->fitSlack = MIN_BLOCK;
+#ifdef MM_THREADS
+    pthread_mutex_init(&a->lock, NULL);
+#endif
+    bp = (char *)a + ARENA_SIZE;
+    PUT(bp, 0);                                        /* alignment padding */
+    PUT(bp + WSIZE, PACK(OVERHEAD, 1));                /* prologue header */
+    PUT(bp + DSIZE, PACK(OVERHEAD, 1));                /* prologue footer */
+    PUT(bp + DSIZE + WSIZE, PACK(0, 1 | PREV_ALLOC));  /* epilogue header */
+    a->heap_listp = bp + DSIZE;
 
-    /* size + overhead aligned */
-    asize = ALIGN(size);
-
-    /* Search the free list for a fit */
-    if ((bp = find_fit(asize)) != NULL)
-    {
-        place(bp, asize);
-        return bp;
-    }
-
-    /* No fit found. Get more memory and place the block */
-    extendsize = MAX(asize, CHUNKSIZE);
-    if ((bp = extend_heap(extendsize / WSIZE)) == NULL)
+    /* Extend the empty heap with a free block of extend_min bytes */
+    if (extend_heap(a, extend_min / WSIZE) == NULL)
     {
         return NULL;
     }
-    place(bp, asize);
-    return bp;
+    return a;
 }
-/* $end mmmalloc */
 
-/* 
- * mm_free - Free a block 
+/*
+ * mm_arena_create - Make a new arena that can grow to size bytes, in a memlib region of its own
  */
-/* $begin mmfree */
-void mm_free(void *bp)
+arena_t mm_arena_create(size_t size)
 {
-    CHECKHEAP(1); /* lets us know each time he goes in the mm_free function when checking the heap */
-    size_t size = GET_SIZE(HDRP(bp));
+    mem_region_t *region;
+    arena_t a;
 
-    PUT(HDRP(bp), PACK(size, 0));
-    PUT(FTRP(bp), PACK(size, 0));
-    addToList(bp);
-    coalesce(bp); /* after each free we coalesce to merge with neighboring free blocks*/
+    if ((region = mem_region_create(size)) == NULL)
+    {
+        return NULL;
+    }
+    if ((a = arena_init(region)) == NULL)
+    { /* too small to hold even an empty heap */
+        mem_region_destroy(region);
+    }
+    return a;
 }
 
-/* $end mmfree */
-
 /*
- * mm_realloc 
- * if the new size is 0 the block is freed,
- * if the new size is smaller then the old one the old pointer is returned.
- * if the pointer ir NULL then mm_mallock is called
- * if the new size is bigger then the old, checks to see if the new size can be fitted in the neighboring blocks conbined with the old one.
- * 
+ * mm_arena_destroy - Throw away an arena and everything allocated in it at once.
+ * The default arena belongs to mm_init and is left alone
  */
-void *mm_realloc(void *ptr, size_t size)
+void mm_arena_destroy(arena_t a)
 {
-    if (size == 0)
-    { /* asked for 0 space, pointer freed */
-        mm_free(ptr);
-        return NULL;
-    }
-    if (ptr == NULL)
-    { /* asked for new malloc */
-        ptr = mm_malloc(size);
-        return ptr;
+    if (a == NULL || a == default_arena)
+    {
+        return;
     }
+#ifdef MM_THREADS
+    pthread_mutex_destroy(&a->lock);
+#endif
+    mem_region_destroy(a->region); /* the arena header goes with it */
+}
 
-    void *newp;
-    size_t copySize, newBlock;
-    size_t newSize = ALIGN(size); /* size aligned + overhead */
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(ptr)));
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(ptr)));
+/* 
+ * mm_malloc - Allocate a block with at least size bytes of payload 
+ */
+/* $begin mmmalloc */
+void *mm_malloc(size_t size)
+{
+    CHECKHEAP(1);      /* lets us know each time he goes in the mm_malloc function when checking the heap */
 
-    copySize = GET_SIZE(HDRP(ptr));
-    if (newSize <= copySize)
-    { /* asked to allocate the same amount of space */
-        return ptr;
+    if (MMAP_THRESHOLD > 0 && size >= MMAP_THRESHOLD)
+    { /* big enough for a mapping of its own */
+        return map_alloc(size);
     }
-    /* at first we implamented this and the following if loops to behave sortof like the function place, */
-    /* So it would segment the blocks if thay were bigger then needed, but after many tries this gave us the best score */
+#ifdef MM_THREADS
+    void *bp;
 
-    else if (!prev_alloc)
-    { /* if the block on the left is not allocated, we try to fit the new allocation in to them conbined */
-        newBlock = (copySize + GET_SIZE(HDRP(PREV_BLKP(ptr))));
-        if (newBlock >= newSize)
-        {
-            newp = PREV_BLKP(ptr);              /* for readability */
-            removeFromList(newp);               /* remove the block on the left from the free list. */
-            PUT(HDRP(newp), PACK(newBlock, 1)); /* change the header of the block on the left */
-            /* memcpy(newp, ptr, newSize); */   /* we'll do memmove instead for better valgrind outputs */
-            memmove(newp, ptr, newSize);        /* copy the contents of the oldblock in to the one on the left */
-            PUT(FTRP(newp), PACK(newBlock, 1)); /* change the footer to match the header */
-            return newp;                        /* return a pointer to the new blocks */
-        }
-    }
-    else if (!next_alloc)
-    { /* if the block on the right is not allocated, we try to fit the new allocation in to them conbined */
-        newBlock = (copySize + GET_SIZE(FTRP(NEXT_BLKP(ptr))));
-        if (newBlock >= newSize)
-        {
-            removeFromList(NEXT_BLKP(ptr));    /* if the newblock fits then we just change the header since the data is already the first thing */
-            PUT(HDRP(ptr), PACK(newBlock, 1)); /* after the header */
-            PUT(FTRP(ptr), PACK(newBlock, 1));
-            return ptr; /* return the old pointer but with new header and footer */
-        }
-    }
-    else if (!prev_alloc && !next_alloc)
-    {                                                                                            /* if both neighboring blocks are unallocated and the new block didn't fit in to just the left or right conbined with the old block */
-        newBlock = (copySize + GET_SIZE(FTRP(NEXT_BLKP(ptr))) + GET_SIZE(FTRP(PREV_BLKP(ptr)))); /* then we check if it fits in all three conbined*/
-        if (newBlock >= newSize)
-        {
-            newp = PREV_BLKP(ptr);
-            removeFromList(newp);               /* remove block on the left */
-            removeFromList(NEXT_BLKP(ptr));     /* remove bblock on the right */
-            PUT(HDRP(newp), PACK(newBlock, 1)); /* change the header of the new block, size of all three and allocated */
-            /* memcpy(newp, ptr, copySize); */  /* we'll do memmove instead for better valgrind outputs */
-            memmove(newp, ptr, copySize);       /* copy contents of the old block */
-            PUT(FTRP(newp), PACK(newBlock, 1)); /* change the footer to match header */
-            return newp;
-        }
+    arena_t a;
+
+    if (size > 0 && (bp = tcache_get(ALIGN(size))) != NULL)
+    { /* a block this thread freed earlier, no lock needed */
+        return bp;
     }
-    else
-    {                           /* at this point in the code the new block didn't fit in to any conbination */
-        newp = mm_malloc(size); /* mallock is called */
-        if (newp == NULL)
-        {
-            printf("ERROR: mm_malloc failed in mm_realloc\n");
-            exit(1);
-        }
-        else
-        {
-            /* memcpy(newp, ptr, size); */ /* we'll do memmove instead for better valgrind outputs */
-            memmove(newp, ptr, size); /* contents copyed over */
-            mm_free(ptr);             /* the old block is freed */
-            return newp;              /* pointer to new block returned */
-        }
+    if ((bp = mm_arena_malloc(a = my_arena(), size)) == NULL && a != default_arena && size > 0)
+    { /* the thread's arena is full, the shared heap takes what doesn't fit */
+        bp = mm_arena_malloc(default_arena, size);
     }
-    return NULL; /* hopfully we never end up here.... */
+    return bp;
+#else
+    return mm_arena_malloc(default_arena, size);
+#endif
 }
+/* $end mmmalloc */
 
-/* 
- * mm_checkheap - Check the heap for consistency 
+/*
+ * mm_malloc_hint - Allocate a block like mm_malloc, hint says how long the caller expects it to live.
+ * Short lived blocks get an arena of their own so the holes they leave don't end up between the long
+ * lived ones, long lived and unhinted blocks share the heap of mm_malloc. mm_free and mm_realloc take
+ * the blocks like any other
  */
-void mm_checkheap(int verbose)
+void *mm_malloc_hint(size_t size, mm_hint_t hint)
 {
-    char *bp = heap_listp;
-
-    if (verbose)
-    {
-        printf("Heap (%p):\n", heap_listp);
-    }
+    arena_t a;
+    void *bp;
 
-    if ((GET_SIZE(HDRP(heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(heap_listp)))
-    {
-        printf("Bad prologue header\n"); /* check if the prolog is allocated and of size 8 */
+    if (hint != SHORT_LIVED || (MMAP_THRESHOLD > 0 && size >= MMAP_THRESHOLD) || (a = short_lived_arena()) == NULL)
+    { /* mappings have no neighbours to fragment */
+        return mm_malloc(size);
     }
-    checkblock(heap_listp); /* check if the first block is correctly aligned and header and footer match */
-
-    for (bp = heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
-    { /* traverse the whole heap exept the epilog and */
-        if (verbose)
-        {                   /* make sure allocated size is always grater then zero */
-            printblock(bp); /* in verbose mode prints all blocks */
-        }
-        checkblock(bp);
+    if ((bp = mm_arena_malloc(a, size)) == NULL && size > 0)
+    { /* the short lived arena is full, the block goes with the others */
+        bp = mm_malloc(size);
     }
+    return bp;
+}
 
-    if (verbose)
-    { /* prints epilog if verbose */
-        printblock(bp);
-    }
+/*
+ * short_lived_arena - The arena of the short lived blocks, made the first time it's needed.
+ * With threads it is shared by all of them and sits on the thread arena list, owned so no
+ * thread takes it as its own
+ */
+static arena_t short_lived_arena(void)
+{
+#ifdef MM_THREADS
+    arena_t a;
 
-    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+    if ((a = __atomic_load_n(&short_arena, __ATOMIC_ACQUIRE)) != NULL)
     {
-        printf("Bad epilogue header\n"); /* check the epilog is allocated zero bits */
+        return a;
     }
-    if (verbose)
+    pthread_mutex_lock(&arenas_lock);
+    if ((a = short_arena) == NULL && (a = mm_arena_create(thread_arena_size)) != NULL)
     {
-        printf("Checking for errors in the free list\n");
+        a->owned = 1;
+        a->next = thread_arenas;
+        thread_arenas = a;
+        __atomic_store_n(&short_arena, a, __ATOMIC_RELEASE);
     }
-    freeListChecker(); /* check if the pointers in the free list are pointing correctly to each other */
-    if (verbose)
-    { /* and are not allocated */
-        printf("All checks of the free list have finished!\n");
+    pthread_mutex_unlock(&arenas_lock);
+    return a;
+#else
+    if (short_arena == NULL)
+    {
+        short_arena = mm_arena_create(thread_arena_size);
     }
+    return short_arena;
+#endif
 }
 
-/* The remaining routines are internal helper routines */
-
-/* 
- * extend_heap - Extend heap with free block and return its block pointer
+/*
+ * mm_region_create - Make an empty region, it takes its first chunk on the first alloc
  */
-/* $begin mmextendheap */
-static void *extend_heap(size_t words)
+mm_region_t mm_region_create(void)
 {
-    char *bp;
-    size_t size;
+    mm_region_t r;
 
-    /* Allocate an even number of words to maintain alignment */
-    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
-    if ((bp = mem_sbrk(size)) == (void *)-1)
+    if ((r = mm_malloc(sizeof(struct mm_region))) == NULL)
     {
         return NULL;
     }
-
-    /* Initialize free block header/footer and the epilogue header */
-    PUT(HDRP(bp), PACK(size, 0));         /* free block header */
-    PUT(FTRP(bp), PACK(size, 0));         /* free block footer */
-    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1)); /* new epilogue header */
-
-    /* Coalesce if the previous block was free */
-    addToList(bp);
-    return coalesce(bp);
+    r->chunks = r->next = r->end = NULL;
+    r->grow = REGION_CHUNK;
+    return r;
 }
-/* $end mmextendheap */
 
-/* 
- * place - Place block of asize bytes at start of free block bp 
- *         and split if remainder would be at least minimum block size
+/*
+ * mm_region_alloc - Bump size bytes off the region's chunk, taking a new chunk from mm_malloc when
+ * it runs out. Big objects get a chunk of their own behind the current one so it keeps being used
  */
-/* $begin mmplace */
-/* $begin mmplace-proto */
-static void place(void *bp, size_t asize)
-/* $end mmplace-proto */
+void *mm_region_alloc(mm_region_t r, size_t size)
 {
-    size_t csize = GET_SIZE(HDRP(bp));
-
-    if ((csize - asize) >= (18*DSIZE + OVERHEAD))      /* if the block left over has enough space for a new block*/
-    {                                                  /* to minimize fragmentation we changed the minimum size of a split block */
-        PUT(HDRP(bp), PACK(asize, 1));               /* we split the block and add the newblock to the freelist*/
-        PUT(FTRP(bp), PACK(asize, 1));
-        removeFromList(bp);                         /* the assigned block is removed*/
-        PUT(HDRP(NEXT_BLKP(bp)), PACK(csize - asize, 0)); /* header and footer size of the new block set as the remainder*/
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(csize - asize, 0));
+    char *bp, *chunk;
+    size_t csize;
 
-        addToList(NEXT_BLKP(bp));                   /* new block added*/
-        coalesce(NEXT_BLKP(bp));
-    }
-    else
+    if (size == 0)
     {
-        PUT(HDRP(bp), PACK(csize, 1));              /* if this code is executed then the block wasn't big enough to be split*/
-        PUT(FTRP(bp), PACK(csize, 1));
-        removeFromList(bp);
+        return NULL;
     }
+    size = (size + ALIGNMENT - 1) & ~(size_t)(ALIGNMENT - 1);
+    if (size <= (size_t)(r->end - r->next))
+    { /* the common case, no header, no lists */
+        bp = r->next;
+        r->next += size;
+        return bp;
+    }
+    if (size >= REGION_BIG && r->chunks != NULL)
+    { /* a chunk of its own, linked in after the current one */
+        if ((chunk = mm_malloc(REGION_LINK + size)) == NULL)
+        {
+            return NULL;
+        }
+        *(char **)chunk = *(char **)r->chunks;
+        *(char **)r->chunks = chunk;
+        return chunk + REGION_LINK;
+    }
+    csize = MAX(r->grow, REGION_LINK + size);
+    if ((chunk = mm_malloc(csize)) == NULL)
+    {
+        return NULL;
+    }
+    *(char **)chunk = r->chunks;
+    r->chunks = chunk;
+    r->next = chunk + REGION_LINK + size;
+    r->end = chunk + csize;
+    r->grow = MIN(2 * r->grow, REGION_CHUNK_MAX);
+    return chunk + REGION_LINK;
+}
+
+/*
+ * mm_region_reset - Free everything allocated from the region at once. The newest chunk, the biggest,
+ * stays for the next round, the others go back to the heap with one mm_free each, however many objects
+ * they held
+ */
+void mm_region_reset(mm_region_t r)
+{
+    if (r->chunks == NULL)
+    {
+        return;
+    }
+    region_free_chunks(*(char **)r->chunks);
+    *(char **)r->chunks = NULL;
+    r->next = r->chunks + REGION_LINK;
+}
+
+/*
+ * mm_region_destroy - Give every chunk of the region back and the region with them
+ */
+void mm_region_destroy(mm_region_t r)
+{
+    if (r == NULL)
+    {
+        return;
+    }
+    region_free_chunks(r->chunks);
+    mm_free(r);
+}
+
+/*
+ * region_free_chunks - mm_free chunk and every chunk taken before it
+ */
+static void region_free_chunks(char *chunk)
+{
+    char *prev;
+
+    for (; chunk != NULL; chunk = prev)
+    {
+        prev = *(char **)chunk;
+        mm_free(chunk);
+    }
+}
+
+/* 
+ * mm_arena_malloc - Allocate a block with at least size bytes of payload from arena a
+ */
+void *mm_arena_malloc(arena_t a, size_t size)
+{
+    void *bp;
+
+    /* Ignore spurious requests */
+    if (size <= 0)
+    {
+        return NULL;
+    }
+    LOCK(a);
+#ifdef MM_THREADS
+    remote_drain(a); /* take back what other threads freed first */
+#endif
+    bp = heap_malloc(a, size);
+    UNLOCK(a);
+    return bp;
+}
+
+/* 
+ * heap_malloc - Allocate from the heap, the caller holds the lock
+ */
+static void *heap_malloc(arena_t a, size_t size)
+{
+    if (size <= SLAB_MAX)
+    { /* small objects go in a slab slot with no header */
+        return slab_alloc(a, size);
+    }
+
+    /* size + overhead aligned */
+    return block_alloc(a, ALIGN(size));
+}
+
+/* 
+ * block_alloc - Allocate a block of asize bytes from the free lists or a heap extension
+ */
+static void *block_alloc(arena_t a, size_t asize)
+{
+    size_t extendsize; /* amount to extend heap if no fit */
+    char *bp;
+
+    size_seen(a, asize);
+
+    /* Search the free list for a fit */
+    if ((bp = find_fit(a, asize)) != NULL)
+    {
+        return place_split(a, bp, asize);
+    }
+
+    /* No fit found. Get more memory and place the block */
+    extendsize = extend_size(a, asize);
+    if ((bp = extend_heap(a, extendsize / WSIZE)) == NULL)
+    {
+        return NULL;
+    }
+    return place_split(a, bp, asize);
+}
+
+/* 
+ * mm_free - Free a block 
+ */
+/* $begin mmfree */
+void mm_free(void *bp)
+{
+    CHECKHEAP(1); /* lets us know each time he goes in the mm_free function when checking the heap */
+    if (bp == NULL)
+    { /* nothing to free */
+        return;
+    }
+    if (IS_MAPPED(bp))
+    { /* the mapping goes back to the system */
+        map_free(bp);
+        return;
+    }
+#ifdef MM_THREADS
+    arena_t a = __atomic_load_n(&short_arena, __ATOMIC_ACQUIRE);
+
+    if ((a == NULL || ARENA_OF(bp) != a) && tcache_put(bp))
+    { /* kept for this thread's next malloc of the same size, short lived blocks go back to their own arena */
+        return;
+    }
+    a = ARENA_OF(bp);
+#ifdef PER_CPU
+    if (a != my_arena() && remote_free(a, bp))
+#else
+    if (a != thread_arena && remote_free(a, bp))
+#endif
+    { /* the owner frees it */
+        return;
+    }
+    mm_arena_free(a, bp);
+#else
+    mm_arena_free(short_arena != NULL ? ARENA_OF(bp) : default_arena, bp);
+#endif
+}
+
+/* $end mmfree */
+
+/* 
+ * mm_arena_free - Free a block that came from arena a
+ */
+void mm_arena_free(arena_t a, void *bp)
+{
+    if (bp == NULL)
+    { /* nothing to free, like mm_free */
+        return;
+    }
+    LOCK(a);
+    heap_free(a, bp);
+    UNLOCK(a);
+}
+
+/* 
+ * heap_free - Give a block or a slab slot back to the heap, the caller holds the lock
+ */
+static void heap_free(arena_t a, void *bp)
+{
+    slab s = slab_owner(a, bp);
+
+    if (s != NULL)
+    { /* small objects just give back their slot */
+        slab_free(a, s, bp);
+        return;
+    }
+    bp = coalesce(a, bp); /* coalesce merges the block with neighboring free blocks, writes the free header and footer */
+                          /* and adds it to the free list */
+    trim_heap(a, bp);
+    a->extendSize = MAX(a->extendSize / 2, extend_min); /* the heap isn't only growing anymore */
+}
+
+/*
+ * mm_realloc 
+ * if the new size is 0 the block is freed,
+ * if the pointer ir NULL then mm_mallock is called
+ * if the new size is smaller then the old one the tail is split off and freed, the old pointer is returned.
+ * if the new size is bigger the block first grows into a free block on the right, which needs no copy,
+ * a block at the top of the heap grows by extending the heap only by what is missing,
+ * then into a free block on the left together with the one on the right. Only when neither fits is a new
+ * block allocated, and only the old payload is ever copied.
+ * 
+ */
+void *mm_realloc(void *ptr, size_t size)
+{
+    if (size == 0)
+    { /* asked for 0 space, pointer freed */
+        mm_free(ptr);
+        return NULL;
+    }
+    if (ptr == NULL)
+    { /* asked for new malloc */
+        ptr = mm_malloc(size);
+        return ptr;
+    }
+    if (IS_MAPPED(ptr))
+    { /* a mapped chunk is resized by the system, unless it got small enough for the heap */
+        return map_realloc(ptr, size);
+    }
+#ifdef MM_THREADS
+    arena_t a = ARENA_OF(ptr);
+#else
+    arena_t a = short_arena != NULL ? ARENA_OF(ptr) : default_arena;
+#endif
+    void *newp;
+
+    if ((newp = mm_arena_realloc(a, ptr, size)) == NULL && a != default_arena)
+    { /* its arena is full */
+        newp = realloc_default(a, ptr, size);
+    }
+    return newp;
+}
+
+/*
+ * realloc_default - Move a block of arena a that has no room to grow to the default arena.
+ * Returns NULL with the block left as it was when the default arena is full too
+ */
+static void *realloc_default(arena_t a, void *ptr, size_t size)
+{
+    void *newp;
+    size_t oldSize;
+    slab s;
+
+    if ((newp = mm_arena_malloc(default_arena, size)) == NULL)
+    {
+        return NULL;
+    }
+    LOCK(a);
+    oldSize = (s = slab_owner(a, ptr)) != NULL ? s->slotSize : GET_SIZE(HDRP(ptr)) - WSIZE;
+    UNLOCK(a);
+    memcpy(newp, ptr, MIN(size, oldSize));
+    mm_free(ptr);
+    return newp;
+}
+
+/* 
+ * mm_arena_realloc - mm_realloc for a block that came from arena a
+ */
+void *mm_arena_realloc(arena_t a, void *ptr, size_t size)
+{
+    void *newp;
+
+    if (size == 0)
+    {
+        mm_arena_free(a, ptr);
+        return NULL;
+    }
+    if (ptr == NULL)
+    {
+        return mm_arena_malloc(a, size);
+    }
+    LOCK(a);
+    newp = heap_realloc(a, ptr, size);
+    UNLOCK(a);
+    return newp;
+}
+
+/* 
+ * heap_realloc - Resize a block or slab slot that is in use, the caller holds the lock
+ */
+static void *heap_realloc(arena_t a, void *ptr, size_t size)
+{
+    void *newp;
+    slab s;
+
+    if ((s = slab_owner(a, ptr)) != NULL)
+    { /* a slot can't grow, so the object moves unless it still fits */
+        if (size <= s->slotSize)
+        {
+            a->reallocStays++;
+            a->savedBytes += MIN(size, s->slotSize);
+            return ptr;
+        }
+        if ((newp = heap_malloc(a, size)) == NULL)
+        {
+            return NULL;
+        }
+        if (size > SLAB_MAX)
+        { /* it outgrew the slabs, a block that grew once will likely grow again */
+            SET_GROWN(HDRP(newp));
+        }
+        memcpy(newp, ptr, s->slotSize);
+        a->reallocMoves++;
+        a->movedBytes += s->slotSize;
+        slab_free(a, s, ptr);
+        return newp;
+    }
+
+    size_t newSize = ALIGN(size); /* size aligned + overhead */
+    size_t oldSize = GET_SIZE(HDRP(ptr));
+    size_t newBlock = oldSize;
+    size_t target = newSize;      /* what the block gets when it has to move */
+    size_t keep = newSize + SPARE(newSize); /* most a block growing in place keeps of its neighbours */
+    void *next = NEXT_BLKP(ptr);
+
+    if (GET_GROWN(HDRP(ptr)))
+    { /* the block keeps growing, leave it room to grow some more */
+        target += SPARE(newSize);
+    }
+    if (newSize <= oldSize)
+    { /* shrinking, or growing in to the spare room */
+        if (target < oldSize)
+        { /* the tail goes back to the free lists, unless it is the spare room of a growing block */
+            shrink_block(a, ptr, target);
+        }
+        a->reallocStays++;
+        a->savedBytes += MIN(size, oldSize - WSIZE);
+        return ptr;
+    }
+    if (!GET_ALLOC(HDRP(next)))
+    { /* the block on the right is free */
+        newBlock += GET_SIZE(HDRP(next));
+        next = NEXT_BLKP(next);
+    }
+    if (newBlock < newSize && GET_SIZE(HDRP(next)) == 0 && !(MMAP_THRESHOLD > 0 && size >= MMAP_THRESHOLD) &&
+        extend_heap(a, MAX(newSize - newBlock, MIN_BLOCK) / WSIZE) != NULL)
+    { /* only the epilogue comes after, the heap grows by the shortfall (at least a free block's worth) */
+      /* and coalesce puts the new space right after the block */
+        newBlock = oldSize + GET_SIZE(HDRP(NEXT_BLKP(ptr)));
+    }
+    if (newBlock >= newSize)
+    { /* growing into the free block on the right needs no copy */
+        removeFromList(a, NEXT_BLKP(ptr));
+        PUT(HDRP(ptr), PACK(newBlock, 1 | GET_PREV_ALLOC(HDRP(ptr)) | GROWN)); /* a block that grew once usually grows again */
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(ptr)));
+        if (newBlock > keep)
+        { /* it keeps its spare room, the rest of the neighbour goes back */
+            shrink_block(a, ptr, keep);
+        }
+        a->reallocStays++;
+        a->savedBytes += oldSize - WSIZE;
+        return ptr;
+    }
+    if (MMAP_THRESHOLD > 0 && size >= MMAP_THRESHOLD && (newp = map_alloc(size)) != NULL)
+    { /* past the threshold a block that can't grow where it is moves out of the heap, mremap grows it from there */
+        memcpy(newp, ptr, oldSize - WSIZE);
+        a->reallocMoves++;
+        a->movedBytes += oldSize - WSIZE;
+        heap_free(a, ptr);
+        return newp;
+    }
+    if (!GET_PREV_ALLOC(HDRP(ptr)) && newBlock + GET_SIZE(HDRP(PREV_BLKP(ptr))) >= newSize)
+    { /* the block on the left, together with the one on the right when it is free, is big enough */
+        newp = PREV_BLKP(ptr);
+        if (newBlock != oldSize)
+        {
+            removeFromList(a, NEXT_BLKP(ptr));
+        }
+        removeFromList(a, newp);                  /* the links live in the payload so they go before the move */
+        newBlock += GET_SIZE(HDRP(newp));
+        memmove(newp, ptr, oldSize - WSIZE);      /* only the old payload is live */
+        PUT(HDRP(newp), PACK(newBlock, 1 | PREV_ALLOC | GROWN));
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(newp)));
+        if (newBlock > keep)
+        {
+            shrink_block(a, newp, keep);
+        }
+        a->reallocMoves++;
+        a->movedBytes += oldSize - WSIZE;
+        return newp;
+    }
+    if ((newp = heap_malloc(a, target - WSIZE)) == NULL && (target == newSize || (newp = heap_malloc(a, size)) == NULL))
+    { /* no room anywhere, the old block stays as it was */
+        return NULL;
+    }
+    if (size > SLAB_MAX)
+    {
+        SET_GROWN(HDRP(newp));
+    }
+    memcpy(newp, ptr, oldSize - WSIZE);
+    a->reallocMoves++;
+    a->movedBytes += oldSize - WSIZE;
+    heap_free(a, ptr);
+    return newp;
+}
+
+/*
+ * shrink_block - Give the tail of the allocated block bp beyond asize back to the free lists
+ * when it is big enough to be a block of its own
+ */
+static void shrink_block(arena_t a, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+
+    if ((csize - asize) >= MIN_BLOCK)
+    {
+        PUT(HDRP(bp), PACK(asize, 1 | (GET(HDRP(bp)) & (PREV_ALLOC | GROWN))));
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(csize - asize, PREV_ALLOC));
+        trim_heap(a, coalesce(a, NEXT_BLKP(bp))); /* the tail may join a free block after it */
+    }
+}
+
+/*
+ * trim_heap - Give the free block bp back to memlib when it is the last block in the heap and at
+ * least TRIM_THRESHOLD bytes. Half the threshold stays, so a heap going up and down around the top
+ * doesn't give pages back only to take them again on the next malloc. Empty slabs kept for their
+ * size go whenever a block that big is freed, so they don't hold the heap up after a spike
+ */
+static void trim_heap(arena_t a, void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t keep = (TRIM_THRESHOLD / 2) & ~(ALIGNMENT - 1);
+
+    if (TRIM_THRESHOLD == 0 || size < TRIM_THRESHOLD)
+    {
+        return;
+    }
+    if (GET_SIZE(HDRP(NEXT_BLKP(bp))) != 0)
+    { /* something is above it, maybe only an empty slab kept for its size */
+        slab_release_empty(a);
+        return;
+    }
+    removeFromList(a, bp);
+    if (keep >= MIN_BLOCK)
+    { /* what stays is a free block of its own */
+        PUT(HDRP(bp), PACK(keep, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(keep, PREV_ALLOC));
+        addToList(a, bp);
+        bp = NEXT_BLKP(bp);
+    }
+    PUT(HDRP(bp), PACK(0, 1 | (keep >= MIN_BLOCK ? 0 : PREV_ALLOC))); /* the new epilogue */
+    mem_region_sbrk(a->region, -(intptr_t)(size - (keep >= MIN_BLOCK ? keep : 0)));
+    slab_release_empty(a); /* an empty slab kept for its size may be right below, with more free space under it */
+}
+
+/* 
+ * mm_checkheap - Check the heap for consistency 
+ */
+void mm_checkheap(int verbose)
+{
+    LOCK(default_arena);
+    heap_check(default_arena, verbose);
+    UNLOCK(default_arena);
+#ifdef MM_THREADS
+    arena_t a;
+
+    pthread_mutex_lock(&arenas_lock);
+    for (a = thread_arenas; a != NULL; a = a->next)
+    { /* and every thread arena */
+        LOCK(a);
+        heap_check(a, verbose);
+        UNLOCK(a);
+    }
+    pthread_mutex_unlock(&arenas_lock);
+#else
+    if (short_arena != NULL)
+    { /* and the short lived blocks */
+        heap_check(short_arena, verbose);
+    }
+#endif
+}
+
+/*
+ * mm_stats - Add up how much memory every arena took from memlib and how much of it
+ * the allocator is holding on to, in free blocks, free slab slots, thread caches and
+ * remote free queues. Other threads should be quiet while it runs
+ */
+void mm_stats(mm_stats_t *stats)
+{
+    memset(stats, 0, sizeof(mm_stats_t));
+    stats->heap_bytes = __atomic_load_n(&mapped_bytes, __ATOMIC_RELAXED);
+    LOCK(default_arena);
+    heap_stats(default_arena, stats);
+    UNLOCK(default_arena);
+#ifdef MM_THREADS
+    arena_t a;
+    threadCache *tc;
+
+    pthread_mutex_lock(&arenas_lock);
+    for (a = thread_arenas; a != NULL; a = a->next)
+    {
+        LOCK(a);
+        heap_stats(a, stats);
+        UNLOCK(a);
+    }
+    for (tc = caches; tc != NULL; tc = tc->next)
+    {
+        stats->cached_bytes += tc->bytes;
+    }
+    pthread_mutex_unlock(&arenas_lock);
+#else
+    if (short_arena != NULL)
+    {
+        heap_stats(short_arena, stats);
+    }
+#endif
+}
+
+/*
+ * heap_stats - Add one arena to the stats, the caller holds the lock
+ */
+static void heap_stats(arena_t a, mm_stats_t *stats)
+{
+    char *bp;
+    unsigned int i;
+
+    stats->heap_bytes += (char *)mem_region_hi(a->region) + 1 - (char *)mem_region_lo(a->region);
+    stats->split_min = MAX(stats->split_min, a->splitMin);
+    stats->fit_slack = MAX(stats->fit_slack, a->fitSlack);
+    stats->sbrk_calls += a->sbrkCalls;
+    stats->sbrk_bytes += a->sbrkBytes;
+    stats->realloc_moves += a->reallocMoves;
+    stats->realloc_stays += a->reallocStays;
+    stats->moved_bytes += a->movedBytes;
+    stats->saved_bytes += a->savedBytes;
+    for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    {
+        if (!GET_ALLOC(HDRP(bp)))
+        {
+            stats->cached_bytes += GET_SIZE(HDRP(bp));
+            stats->largest_free = MAX(stats->largest_free, GET_SIZE(HDRP(bp)));
+#ifdef SCAVENGE
+            char *lo;
+
+            if (GET_SIZE(HDRP(bp)) >= SCAVENGE_MIN && GET(STAMPP(bp)) == RELEASED)
+            {
+                stats->released_bytes += free_pages(bp, &lo);
+            }
+#endif
+        }
+    }
+    for (i = 0; i < a->slabs.count; i++)
+    {
+        stats->cached_bytes += a->slabs.registry[i]->freeSlots * a->slabs.registry[i]->slotSize;
+    }
+#ifdef MM_THREADS
+    for (bp = __atomic_load_n(&a->remote, __ATOMIC_ACQUIRE); bp != NULL; bp = *(void **)bp)
+    { /* pushes only go in front, so the rest of the queue holds still under the lock */
+        stats->cached_bytes += GET_SIZE(HDRP(bp));
+    }
+#endif
+}
+
+/* 
+ * heap_check - Check one arena, the caller holds the lock
+ */
+static void heap_check(arena_t a, int verbose)
+{
+    char *bp = a->heap_listp;
+    int freeBlocks = 0;
+
+    if (verbose)
+    {
+        printf("Heap (%p):\n", a->heap_listp);
+    }
+
+    if ((GET_SIZE(HDRP(a->heap_listp)) != DSIZE) || !GET_ALLOC(HDRP(a->heap_listp)))
+    {
+        printf("Bad prologue header\n"); /* check if the prolog is allocated and of size OVERHEAD */
+    }
+    checkblock(a->heap_listp); /* check if the first block is correctly aligned and header and footer match */
+
+    for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    { /* traverse the whole heap exept the epilog and */
+        if (verbose)
+        {                   /* make sure allocated size is always grater then zero */
+            printblock(bp); /* in verbose mode prints all blocks */
+        }
+        checkblock(bp);
+        if (!GET_ALLOC(HDRP(bp)))
+        {
+            freeBlocks++;
+        }
+    }
+
+    if (verbose)
+    { /* prints epilog if verbose */
+        printblock(bp);
+    }
+
+    if ((GET_SIZE(HDRP(bp)) != 0) || !(GET_ALLOC(HDRP(bp))))
+    {
+        printf("Bad epilogue header\n"); /* check the epilog is allocated zero bits */
+    }
+    if (verbose)
+    {
+        printf("Checking for errors in the free list\n");
+    }
+    if (freeListChecker(a) != freeBlocks)
+    { /* check if the pointers in the free list are pointing correctly to each other */
+        printf("Free block count does not match the free list\n"); /* and that every free block is in it */
+    }
+    slabChecker(a); /* check the slab registry and the free slot counts */
+    if (verbose)
+    { /* and are not allocated */
+        printf("All checks of the free list have finished!\n");
+    }
+}
+
+/* The remaining routines are internal helper routines */
+
+/* 
+ * extend_heap - Extend heap with free block and return its block pointer
+ */
+/* $begin mmextendheap */
+static void *extend_heap(arena_t a, size_t words)
+{
+    char *bp;
+    size_t size;
+
+    /* Allocate an even number of words to maintain alignment */
+    size = (words % 2) ? (words + 1) * WSIZE : words * WSIZE;
+    if ((unsigned long long)((char *)mem_region_hi(a->region) + 1 + size - (char *)a) > LINK_SPAN)
+    { /* the free list links couldn't reach the new block */
+        return NULL;
+    }
+    if (size > mem_region_left(a->region))
+    { /* the arena is full, the caller can go to another one */
+        return NULL;
+    }
+    if ((bp = mem_region_sbrk(a->region, (intptr_t)size)) == (void *)-1)
+    {
+        return NULL;
+    }
+    a->sbrkCalls++;
+    a->sbrkBytes += size;
+
+    /* Initialize free block header and the epilogue header, the old epilogue knows if the last block is allocated */
+    PUT(HDRP(bp), PACK(size, GET_PREV_ALLOC(HDRP(bp)))); /* free block header, coalesce writes the footer */
+    PUT(HDRP(NEXT_BLKP(bp)), PACK(0, 1));                /* new epilogue header */
+
+    /* Coalesce if the previous block was free */
+    return coalesce(a, bp);
+}
+/* $end mmextendheap */
+
+/*
+ * extend_size - How much to grow the heap by for a request of asize bytes that didn't fit,
+ * the step doubles every time so a heap that keeps growing asks memlib less and less often
+ */
+static size_t extend_size(arena_t a, size_t asize)
+{
+    size_t size = MAX(asize, a->extendSize);
+
+    a->extendSize = MIN(2 * a->extendSize, extend_max);
+    return size;
+}
+
+/*
+ * size_seen - Count a request of asize bytes in the histogram, every SIZE_WINDOW requests the split
+ * threshold and the fit slack are worked out again from it and the older requests lose half their weight
+ */
+static void size_seen(arena_t a, size_t asize)
+{
+    unsigned int i, total = 0, seen = 0;
+    size_t split = 0, slack = 0, cut = 0;
+
+    a->sizeHist[MIN(FLS(asize), SIZE_BUCKETS - 1)]++;
+    if (++a->sizeCount < SIZE_WINDOW)
+    {
+        return;
+    }
+    a->sizeCount = 0;
+    for (i = 0; i < SIZE_BUCKETS; i++)
+    {
+        total += a->sizeHist[i];
+    }
+    for (i = 0; i < SIZE_BUCKETS; i++)
+    { /* bucket i holds the sizes from 2^i up to 2^(i+1) */
+        seen += a->sizeHist[i];
+        if (split == 0 && seen * 100 >= total * SPLIT_PCT)
+        {
+            split = (size_t)1 << i;
+        }
+        if (slack == 0 && seen * 100 >= total * SLACK_PCT)
+        {
+            slack = (size_t)1 << i;
+        }
+        if (cut == 0 && seen * 100 >= total * SMALL_PCT)
+        { /* the whole bucket counts as small */
+            cut = (size_t)2 << i;
+        }
+        a->sizeHist[i] /= 2;
+    }
+    a->splitMin = MAX(split, MIN_BLOCK);
+    a->fitSlack = MAX(slack, MIN_BLOCK);
+    a->smallCut = cut;
+}
+
+/*
+ * mm_set_extend - The heap grows by at least min bytes and sustained growth works up to max bytes
+ * at a time, for the arenas laid out after the call. Both are rounded up to whole double words and
+ * never go below MIN_BLOCK, the first free block of an arena has to hold its links and its footer
+ */
+void mm_set_extend(size_t min, size_t max)
+{
+    extend_min = MAX((min + DSIZE - 1) & ~(size_t)(DSIZE - 1), MIN_BLOCK);
+    extend_max = MAX((max + DSIZE - 1) & ~(size_t)(DSIZE - 1), extend_min);
+}
+
+/* 
+ * place - Place block of asize bytes at start of free block bp 
+ *         and split if remainder would be at least minimum block size
+ */
+/* $begin mmplace */
+/* $begin mmplace-proto */
+static void place(arena_t a, void *bp, size_t asize)
+/* $end mmplace-proto */
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+
+    if ((csize - asize) >= a->splitMin)                /* if the block left over is big enough for a typical request */
+    {                                                  /* we split it off, smaller remainders would only fragment the heap */
+        removeFromList(a, bp);                         /* the assigned block is removed before its size changes*/
+        PUT(HDRP(bp), PACK(asize, 1 | GET_PREV_ALLOC(HDRP(bp)))); /* we split the block and add the newblock to the freelist*/
+        PUT(HDRP(NEXT_BLKP(bp)), PACK(csize - asize, PREV_ALLOC)); /* header size of the new block set as the remainder*/
+
+        coalesce(a, NEXT_BLKP(bp));                    /* new block gets its footer and is added to the free list*/
+    }
+    else
+    {
+        removeFromList(a, bp);
+        PUT(HDRP(bp), PACK(csize, 1 | GET_PREV_ALLOC(HDRP(bp)))); /* if this code is executed then the block wasn't big enough to be split*/
+        SET_PREV_ALLOC(HDRP(NEXT_BLKP(bp)));        /* the block after it needs to know it's allocated now */
+    }
+}
+/* $end mmplace */
+
+/*
+ * place_split - Place a block of asize bytes in free block bp at the end SPLIT_PLACE picks for
+ *         its size and return it. Only blocks that get split are cut at the back, the rest goes to place
+ */
+static void *place_split(arena_t a, void *bp, size_t asize)
+{
+    size_t csize = GET_SIZE(HDRP(bp));
+    size_t rsize = csize - asize;
+    char *ap;
+
+    if (SPLIT_PLACE == FRONT || rsize < a->splitMin ||
+        (asize < a->smallCut) != (SPLIT_PLACE == SMALL_BACK))
+    {
+        place(a, bp, asize);
+        return bp;
+    }
+    removeFromList(a, bp);                              /* the front stays free but its size class may change */
+    PUT(HDRP(bp), PACK(rsize, PREV_ALLOC));             /* the block before a free block is always allocated */
+    PUT(FTRP(bp), PACK(rsize, PREV_ALLOC));
+    addToList(a, bp);
+    ap = NEXT_BLKP(bp);
+    PUT(HDRP(ap), PACK(asize, 1));                      /* the block before it is the free front */
+    SET_PREV_ALLOC(HDRP(NEXT_BLKP(ap)));
+    return ap;
+}
+
+#if FREE_INDEX == TLSF
+/* 
+ * find_fit - Find a fit for a block with asize bytes 
+ * asize is rounded up to the next list boundary so the first block of any list at or above
+ * it is big enough, the bitmaps then give the first non empty list without any searching.
+ * Only the head of the list for asize itself is looked at before rounding
+ */
+static void *find_fit(arena_t a, size_t asize)
+{
+    int index, fl, sl;
+    unsigned int map;
+    listNode bp;
+    size_t rsize = asize;
+
+    bp = NEXT(a, LISTHEAD(a, list_index(asize)));
+    if (bp != NULL && GET_SIZE(HDRP(bp)) >= asize)
+    { /* the first block in the list for asize itself fits, this keeps exact size reuse from growing the heap */
+        return bp;
+    }
+    if (rsize >= SMALL_BLOCK)
+    { /* small lists hold a single size so only the bigger ones need rounding */
+        rsize += ((size_t)1 << (FLS(rsize) - SL_SHIFT)) - 1;
+    }
+    index = list_index(rsize);
+    fl = index / SL_COUNT;
+    sl = index % SL_COUNT;
+
+    map = a->findex.sl_bitmap[fl] & (~0U << sl);
+    if (map == 0)
+    { /* nothing big enough in this first level, move to the next non empty one */
+        map = a->findex.fl_bitmap & (~0U << (fl + 1));
+        if (map == 0)
+        {
+            return NULL; /* no fit :( */
+        }
+        fl = FFS(map);
+        map = a->findex.sl_bitmap[fl];
+    }
+    sl = FFS(map);
+
+    bp = NEXT(a, LISTHEAD(a, fl * SL_COUNT + sl));
+    if (fl * SL_COUNT + sl == NUM_LISTS - 1)
+    { /* the last list has no upper bound so it's the only one that has to be searched */
+        while (bp != NULL && GET_SIZE(HDRP(bp)) < asize)
+        {
+            bp = NEXT(a, bp);
+        }
+    }
+    return bp;
+}
+
+/*
+ * list_index - index of the free list that holds blocks of the given size,
+ * first level times SL_COUNT plus second level
+ */
+static int list_index(size_t size)
+{
+    int msb, fl, sl;
+
+    if (size < SMALL_BLOCK)
+    {
+        return size >> ALIGN_SHIFT;
+    }
+    msb = FLS(size);
+    fl = msb - FL_SHIFT + 1;
+    sl = (size >> (msb - SL_SHIFT)) ^ SL_COUNT; /* the SL_SHIFT bits below the leading one */
+    if (fl >= FL_COUNT)
+    {
+        return NUM_LISTS - 1;
+    }
+    return fl * SL_COUNT + sl;
+}
+#elif FREE_INDEX == TREE
+/* 
+ * find_fit - Find the smallest free block with at least asize bytes,
+ * the lowest address wins between blocks of the same size
+ */
+static void *find_fit(arena_t a, size_t asize)
+{
+    treeNode node = FROM_LINK(a, a->findex.root);
+    treeNode bestFit = NULL;
+
+    while (node != NULL)
+    {
+        if (GET_SIZE(HDRP(node)) >= asize)
+        { /* fits, but there might be a smaller one on the left */
+            bestFit = node;
+            node = LEFT(a, node);
+        }
+        else
+        {
+            node = RIGHT(a, node);
+        }
+    }
+    return bestFit;
+}
+#elif FIT_POLICY == NEXT_FIT
+/* 
+ * find_fit - Find a fit for a block with asize bytes with next fit. The search of a class
+ * starts at its rover, the block it handed out last or the one after it if that was taken,
+ * and wraps around to the head, so the lists are worn evenly instead of from the front
+ */
+static void *find_fit(arena_t a, size_t asize)
+{
+    int class;
+    listNode bp, rover;
+
+    for (class = list_index(asize); class < NUM_CLASSES; class++)
+    {
+        rover = FROM_LINK(a, a->findex.rover[class]);
+        for (bp = rover; bp != NULL; bp = NEXT(a, bp))
+        { /* from the rover to the end of the list */
+            if (asize <= GET_SIZE(HDRP(bp)))
+            {
+                a->findex.rover[class] = TO_LINK(a, bp);
+                return bp;
+            }
+        }
+        for (bp = NEXT(a, LISTHEAD(a, class)); bp != rover; bp = NEXT(a, bp))
+        { /* and from the head back to the rover */
+            if (asize <= GET_SIZE(HDRP(bp)))
+            {
+                a->findex.rover[class] = TO_LINK(a, bp);
+                return bp;
+            }
+        }
+    }
+    return NULL; /* no fit :( */
+}
+
+/*
+ * list_index - index of the free list (size class) that holds blocks of the given size
+ */
+static int list_index(size_t size)
+{
+    int class = 0;
+
+    for (size >>= CLASS_SHIFT; size > 1 && class < NUM_CLASSES - 1; size >>= 1)
+    {
+        class++;
+    }
+    return class;
+}
+#else
+/* How big a remainder find_fit settles for, first fit takes any block and best fit only an exact one */
+#if FIT_POLICY == GOOD_FIT
+#define FIT_SLACK(a) ((a)->fitSlack)
+#elif FIT_POLICY == BEST_FIT
+#define FIT_SLACK(a) 0
+#else
+#define FIT_SLACK(a) ((size_t)-1)
+#endif
+
+/* 
+ * find_fit - Find a fit for a block with asize bytes 
+ * implemented with best fit and a tolarence for wasted space so we don't always
+ * have to traverse the whole list. The search starts at the size class of asize
+ * and only moves on to the bigger classes if nothing in it fits.
+ * FIT_SLACK sets the tolerance, which makes the same search first fit or exact best fit
+ */
+static void *find_fit(arena_t a, size_t asize)
+{
+    int class;
+    listNode bp, bestFit;
+    size_t remainder;
+
+    for (class = list_index(asize); class < NUM_CLASSES; class++)
+    { /* best fit search within one class */
+        bestFit = NULL;
+        remainder = (size_t)-1; /* bigger then any block, a fixed number would skip blocks past it */
+        for (bp = NEXT(a, LISTHEAD(a, class)); bp != NULL; bp = NEXT(a, bp))
+        {
+            if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))) && (GET_SIZE(HDRP(bp)) - asize) < remainder)
+            {
+                remainder = GET_SIZE(HDRP(bp)) - asize; /* the remainder of the block that was not asked for */
+                bestFit = bp;
+                if (remainder <= FIT_SLACK(a))
+                { /* the remainder is no bigger than a typical request, so the block is considered good enough */
+                    return bestFit;
+                }
+            }
+        }
+        if (bestFit != NULL)
+        { /* every block in the bigger classes is bigger then this one so no need to look further */
+            return bestFit;
+        }
+    }
+    return NULL; /* no fit :( */
+}
+
+/*
+ * list_index - index of the free list (size class) that holds blocks of the given size
+ */
+static int list_index(size_t size)
+{
+    int class = 0;
+
+    for (size >>= CLASS_SHIFT; size > 1 && class < NUM_CLASSES - 1; size >>= 1)
+    {
+        class++;
+    }
+    return class;
+}
+#endif
+
+/*
+ * coalesce - boundary tag coalescing. bp must not be in a free list yet, the coalesced block
+ * is added to the list for its size class once its final size is known. Return ptr to coalesced block
+ */
+static void *coalesce(arena_t a, void *bp)
+{
+    size_t prev_alloc = GET_PREV_ALLOC(HDRP(bp)); 
+    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
+    size_t size = GET_SIZE(HDRP(bp));
+
+    if (prev_alloc && next_alloc)           /* if both neighbor blocks are allocated we have nothing to coalesce */
+    { /* Case 1 */                          /* and the pointer is returned unchaged*/
+    }
+    else if (prev_alloc && !next_alloc)    /* if the block on the left is allocated and the one on the right isn't, */
+    { /* Case 2 */                         /* the currant block grows over the one on the right*/
+        removeFromList(a, NEXT_BLKP(bp));     /* the block on the right is removed from the free list since it is now merged with the currant*/
+        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
+    }
+    else if (!prev_alloc && next_alloc)   /* if the one on the right is allocated but the one on the left isn't, the block on the left */
+    { /* Case 3 */                        /* grows over the currant one, it is removed since it's size class might change */
+        removeFromList(a, PREV_BLKP(bp));
+        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
+        bp = PREV_BLKP(bp);
+    }
+    else
+    { /* Case 4 */                         /* in the last case both blocks ar unallocated, and the block on the left grows over both*/
+        removeFromList(a, NEXT_BLKP(bp));     /* the middle part is garbage and is ignored*/
+        removeFromList(a, PREV_BLKP(bp));     /* both neighbors are removed from the free list and the merged block added back below */
+        size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
+                GET_SIZE(HDRP(NEXT_BLKP(bp)));
+        bp = PREV_BLKP(bp);
+    }
+
+    /* the block before a free block is always allocated, otherwise they would have been merged */
+    PUT(HDRP(bp), PACK(size, PREV_ALLOC));
+    PUT(FTRP(bp), PACK(size, PREV_ALLOC));
+    CLEAR_PREV_ALLOC(HDRP(NEXT_BLKP(bp))); /* and the block after it has to know it's free */
+    addToList(a, bp); /* the merged block goes in the list for its new size */
+    return bp;
+}
+
+/* 
+ * alloc_aligned - Allocate a block of asize bytes whose payload is aligned to align.
+ * The block found is big enough to cut a free block of at least MIN_BLOCK from the front
+ * when the payload isn't aligned already, place splits the tail as usual
+ */
+static void *alloc_aligned(arena_t a, size_t asize, size_t align)
+{
+    size_t request = asize + align + MIN_BLOCK;
+    size_t csize, gap;
+    char *bp, *ap;
+
+    if ((bp = find_fit(a, request)) == NULL && (bp = extend_heap(a, extend_size(a, request) / WSIZE)) == NULL)
+    {
+        return NULL;
+    }
+    ap = (char *)(((size_t)bp + align - 1) & ~(align - 1));
+    if (ap != bp && ap - bp < MIN_BLOCK)
+    { /* the front is too small to be a block on its own */
+        ap += align;
+    }
+    if (ap != bp)
+    { /* the front goes back to the free list and the rest becomes a free block of its own */
+        csize = GET_SIZE(HDRP(bp));
+        gap = ap - bp;
+        removeFromList(a, bp);
+        PUT(HDRP(bp), PACK(gap, PREV_ALLOC));
+        PUT(FTRP(bp), PACK(gap, PREV_ALLOC));
+        addToList(a, bp);
+        PUT(HDRP(ap), PACK(csize - gap, 0));
+        PUT(FTRP(ap), PACK(csize - gap, 0));
+        addToList(a, ap);
+    }
+    place(a, ap, asize);
+    return ap;
+}
+
+/*
+ * slab_new - Get a new slab for the given slot size class and put it on the partial list
+ */
+static slab slab_new(arena_t a, int class)
+{
+    slab s;
+    slab *registry;
+    unsigned int i;
+
+    if (a->slabs.count == a->slabs.capacity)
+    { /* the registry is full, move it to a block twice as big */
+        if ((registry = block_alloc(a, ALIGN(MAX(16, 2 * a->slabs.capacity) * sizeof(slab)))) == NULL)
+        {
+            return NULL;
+        }
+        if (a->slabs.registry != NULL)
+        {
+            memcpy(registry, a->slabs.registry, a->slabs.count * sizeof(slab));
+            coalesce(a, a->slabs.registry);
+        }
+        a->slabs.registry = registry;
+        a->slabs.capacity = MAX(16, 2 * a->slabs.capacity);
+    }
+    if ((s = alloc_aligned(a, ALIGN(SLAB_SIZE), SLAB_SIZE)) == NULL)
+    {
+        return NULL;
+    }
+
+    s->id = a->slabs.count;
+    a->slabs.registry[a->slabs.count++] = s;
+    s->slotSize = class * ALIGNMENT;
+    s->slots = (SLAB_SIZE - SLAB_HDR) / s->slotSize;
+    s->freeSlots = s->slots;
+    s->summary = 0;
+    for (i = 0; i < SLAB_WORDS; i++)
+    { /* every slot starts out free */
+        if (i < s->slots / 32)
+        {
+            s->bitmap[i] = ~0U;
+        }
+        else if (i == s->slots / 32 && s->slots % 32 != 0)
+        {
+            s->bitmap[i] = ~0U >> (32 - s->slots % 32);
+        }
+        else
+        {
+            s->bitmap[i] = 0;
+        }
+        if (s->bitmap[i] != 0)
+        {
+            s->summary |= 1U << i;
+        }
+    }
+    s->prev = NULL;
+    s->next = a->slabs.partial[class];
+    if (s->next != NULL)
+    {
+        s->next->prev = s;
+    }
+    a->slabs.partial[class] = s;
+    return s;
+}
+
+/*
+ * slab_alloc - Take the first free slot of a slab with the right slot size,
+ * the summary word tells which bitmap word has one
+ */
+static void *slab_alloc(arena_t a, size_t size)
+{
+    int class = (size + ALIGNMENT - 1) / ALIGNMENT;
+    int word, bit;
+    slab s = a->slabs.partial[class];
+
+    if (s == NULL && (s = slab_new(a, class)) == NULL)
+    {
+        return NULL;
+    }
+    word = FFS(s->summary);
+    bit = FFS(s->bitmap[word]);
+    s->bitmap[word] &= ~(1U << bit);
+    if (s->bitmap[word] == 0)
+    {
+        s->summary &= ~(1U << word);
+    }
+    if (--s->freeSlots == 0)
+    { /* full slabs leave the partial list */
+        a->slabs.partial[class] = s->next;
+        if (s->next != NULL)
+        {
+            s->next->prev = NULL;
+        }
+        s->next = NULL;
+    }
+    return (char *)s + SLAB_HDR + (word * 32 + bit) * s->slotSize;
+}
+
+/*
+ * slab_free - Give a slot back to its slab. A slab that becomes empty is freed
+ * unless it's the only one left with free slots of its size, and even then when
+ * it is all that keeps a free block of TRIM_THRESHOLD bytes from the top of the heap
+ */
+static void slab_free(arena_t a, slab s, void *ptr)
+{
+    int class = s->slotSize / ALIGNMENT;
+    int slot = ((char *)ptr - ((char *)s + SLAB_HDR)) / s->slotSize;
+    size_t size;
+    void *next;
+
+    s->bitmap[slot / 32] |= 1U << (slot % 32);
+    s->summary |= 1U << (slot / 32);
+    if (s->freeSlots++ == 0)
+    { /* it has a free slot again */
+        s->prev = NULL;
+        s->next = a->slabs.partial[class];
+        if (s->next != NULL)
+        {
+            s->next->prev = s;
+        }
+        a->slabs.partial[class] = s;
+    }
+    if (s->freeSlots < s->slots)
+    {
+        return;
+    }
+    if (s->prev != NULL || s->next != NULL)
+    { /* empty and there are others to use */
+        slab_release(a, s);
+        return;
+    }
+    next = NEXT_BLKP(s);
+    size = GET_SIZE(HDRP(s));
+    if (!GET_PREV_ALLOC(HDRP(s)))
+    {
+        size += GET_SIZE(HDRP(PREV_BLKP(s)));
+    }
+    if (!GET_ALLOC(HDRP(next)))
+    {
+        size += GET_SIZE(HDRP(next));
+        next = NEXT_BLKP(next);
+    }
+    if (TRIM_THRESHOLD > 0 && size >= TRIM_THRESHOLD && GET_SIZE(HDRP(next)) == 0)
+    { /* the last of its size, but it would pin the top of an emptied heap */
+        slab_release(a, s);
+    }
+}
+
+/*
+ * slab_release - Take an empty slab out of the partial list and the registry and free its block,
+ * and the registry's block with the last slab
+ */
+static void slab_release(arena_t a, slab s)
+{
+    int class = s->slotSize / ALIGNMENT;
+    slab *registry;
+
+    if (s->prev != NULL)
+    {
+        s->prev->next = s->next;
+    }
+    else
+    {
+        a->slabs.partial[class] = s->next;
+    }
+    if (s->next != NULL)
+    {
+        s->next->prev = s->prev;
+    }
+    a->slabs.registry[s->id] = a->slabs.registry[--a->slabs.count];
+    a->slabs.registry[s->id]->id = s->id;
+    trim_heap(a, coalesce(a, s));
+    if (a->slabs.count == 0 && a->slabs.registry != NULL)
+    { /* the last slab is gone, the registry goes too so it doesn't pin the heap */
+        registry = a->slabs.registry;
+        a->slabs.registry = NULL;
+        a->slabs.capacity = 0;
+        trim_heap(a, coalesce(a, registry));
+    }
+}
+
+/*
+ * slab_release_empty - Free the empty slabs kept for their size, so a big free block below
+ * them can reach the top of the heap and be trimmed
+ */
+static void slab_release_empty(arena_t a)
+{
+    int i;
+    slab s;
+
+    for (i = 1; i <= SLAB_CLASSES; i++)
+    {
+        s = a->slabs.partial[i];
+        if (s != NULL && s->next == NULL && s->freeSlots == s->slots)
+        {
+            slab_release(a, s);
+        }
+    }
+}
+
+/*
+ * slab_owner - Return the slab that ptr is in, or NULL if ptr is a normal block
+ */
+static slab slab_owner(arena_t a, void *ptr)
+{
+    slab s = SLABP(ptr);
+
+#if SLAB_MAX == 0
+    return NULL; /* there are no slabs, and the page's first word may be another thread's data */
+#endif
+    if ((char *)s < a->heap_listp)
+    { /* the page starts before the first block */
+        return NULL;
+    }
+    if (s->id < a->slabs.count && a->slabs.registry[s->id] == s)
+    {
+        return s;
+    }
+    return NULL;
+}
+
+/*
+ * slabChecker - Checks that the registry and the partial lists agree with the slabs
+ */
+static void slabChecker(arena_t a)
+{
+    unsigned int i, w, free;
+    slab s;
+
+    for (i = 0; i < a->slabs.count; i++)
+    {
+        s = a->slabs.registry[i];
+        if (s->id != i || SLABP(s) != s)
+        { /* every slab knows where it is in the registry */
+            printf("Slab %p has a bad id or alignment\n", (void *)s);
+        }
+        if (!GET_ALLOC(HDRP(s)))
+        { /* and lives in an allocated block */
+            printf("Slab %p is in a free block\n", (void *)s);
+        }
+        for (w = 0, free = 0; w < SLAB_WORDS; w++)
+        {
+            free += __builtin_popcount(s->bitmap[w]);
+            if (!(s->summary & (1U << w)) != (s->bitmap[w] == 0))
+            {
+                printf("Slab %p summary out of sync with word %d\n", (void *)s, w);
+            }
+        }
+        if (free != s->freeSlots)
+        {
+            printf("Slab %p free slot count is wrong\n", (void *)s);
+        }
+    }
+    for (i = 1; i <= SLAB_CLASSES; i++)
+    {
+        for (s = a->slabs.partial[i]; s != NULL; s = s->next)
+        {
+            if (s->freeSlots == 0 || s->slotSize != i * ALIGNMENT)
+            { /* only slabs with free slots of the right size are on a partial list */
+                printf("Slab %p on the wrong partial list\n", (void *)s);
+            }
+        }
+    }
+}
+
+#ifdef MM_THREADS
+/*
+ * tcache_get - Pop a block of exactly asize bytes from this thread's cache, or NULL if there is none
+ */
+static void *tcache_get(size_t asize)
+{
+    size_t class = asize / ALIGNMENT;
+    void *bp;
+
+    if (asize > TCACHE_MAX || (bp = tcache.head[class]) == NULL)
+    {
+        return NULL;
+    }
+    tcache.head[class] = *(void **)bp;
+    tcache.count[class]--;
+    tcache.bytes -= asize;
+    return bp;
 }
-/* $end mmplace */
 
-/* 
- * find_fit - Find a fit for a block with asize bytes 
- * implemented with best fit and a tolarence for wasted space so we don't always
- * have to traverse the whole list
+/*
+ * tcache_put - Keep a freed block in this thread's cache, returns 0 if it is too big or the list is full.
+ * The size is read from the header without the lock, a neighbour may flip the prev bit in it meanwhile
+ * but nobody changes the size while the block is allocated, and GET and PUT are atomic with threads
+ */
+static int tcache_put(void *bp)
+{
+    size_t size = GET_SIZE(HDRP(bp));
+    size_t class = size / ALIGNMENT;
+
+    if (size > TCACHE_MAX || tcache.count[class] >= TCACHE_COUNT)
+    {
+        return 0;
+    }
+    thread_register(); /* make sure the cache is handed back when the thread exits */
+    *(void **)bp = tcache.head[class];
+    tcache.head[class] = bp;
+    tcache.count[class]++;
+    tcache.bytes += size;
+    return 1;
+}
+
+/*
+ * thread_exit - Free every block in an exiting thread's cache and give up its arena,
+ * the next new thread adopts it
+ */
+static void thread_exit(void *cache)
+{
+    threadCache *tc = cache, **link;
+    arena_t a;
+    size_t i;
+    void *bp;
+
+    pthread_mutex_lock(&arenas_lock);
+    for (link = &caches; *link != NULL && *link != tc; link = &(*link)->next)
+        ;
+    if (*link == tc)
+    { /* mm_stats stops counting it */
+        *link = tc->next;
+    }
+    pthread_mutex_unlock(&arenas_lock);
+    for (i = 0; i <= TCACHE_CLASSES; i++)
+    {
+        while ((bp = tc->head[i]) != NULL)
+        { /* the blocks can be from any arena */
+            tc->head[i] = *(void **)bp;
+            a = ARENA_OF(bp);
+            LOCK(a);
+            heap_free(a, bp);
+            UNLOCK(a);
+        }
+        tc->count[i] = 0;
+    }
+    tc->bytes = 0;
+    tc->registered = 0;
+    if ((a = thread_arena) != NULL && a != default_arena)
+    { /* from now on frees go straight to the arena, except what is already queued */
+        __atomic_store_n(&a->owned, 0, __ATOMIC_SEQ_CST);
+        LOCK(a);
+        remote_drain(a);
+        UNLOCK(a);
+    }
+    thread_arena = NULL;
+}
+
+/*
+ * tcache_key_init - Create the key whose destructor cleans up after an exiting thread
+ */
+static void tcache_key_init(void)
+{
+    pthread_key_create(&tcache_key, thread_exit);
+}
+
+/*
+ * thread_register - Put this thread's cache on the caches list and have thread_exit run
+ * when the thread exits, the first time it is called in a thread
+ */
+static void thread_register(void)
+{
+    if (tcache.registered)
+    {
+        return;
+    }
+    pthread_once(&tcache_once, tcache_key_init);
+    pthread_setspecific(tcache_key, &tcache);
+    pthread_mutex_lock(&arenas_lock);
+    tcache.next = caches;
+    caches = &tcache;
+    pthread_mutex_unlock(&arenas_lock);
+    tcache.registered = 1;
+}
+
+#ifdef PER_CPU
+/*
+ * my_arena - The arena of the cpu this thread runs on. The thread can be moved to another
+ * cpu right after, which only costs some contention on the lock. Cpu arenas are always owned
+ * so blocks freed on another cpu go through the queue and the next malloc on their cpu frees them
  */
-static void *find_fit(size_t asize)
+static arena_t my_arena(void)
 {
-    /* best fit search */
-    listNode bp = LISTHEAD->next;
-    listNode bestFit = NULL;
-    size_t remainder = 9999999; /* some huges number */
-    for (; bp != NULL; bp = bp->next)
+    static int next_slot;              /* round robin when sched_getcpu isn't there */
+    static __thread int slot = -1;
+    int cpu = sched_getcpu();
+    arena_t a;
+
+    if (cpu < 0)
     {
-        if (!GET_ALLOC(HDRP(bp)) && (asize <= GET_SIZE(HDRP(bp))) && (GET_SIZE(HDRP(bp)) - asize) < remainder)
+        if (slot < 0)
         {
-            remainder = GET_SIZE(HDRP(bp)) - asize; /* the remainder of the block that was not asked for */
-            bestFit = bp;
-            if (remainder <= 3904)
-            {                   // when the remainder of the block is less then 3904 bits the block is considered goodenough
-                return bestFit; // the number 3904 is divisable by 8 and then 4 and was found through trial and error
-            }
+            slot = __atomic_fetch_add(&next_slot, 1, __ATOMIC_RELAXED) % sysconf(_SC_NPROCESSORS_CONF);
         }
+        cpu = slot;
+    }
+    cpu %= MAX_CPUS;
+    if ((a = __atomic_load_n(&cpu_arenas[cpu], __ATOMIC_ACQUIRE)) != NULL)
+    {
+        return a;
+    }
+    pthread_mutex_lock(&arenas_lock);
+    if ((a = cpu_arenas[cpu]) == NULL && (a = mm_arena_create(thread_arena_size)) != NULL)
+    { /* first time on this cpu */
+        a->owned = 1;
+        a->next = thread_arenas;
+        thread_arenas = a;
+        __atomic_store_n(&cpu_arenas[cpu], a, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&arenas_lock);
+    return (a != NULL) ? a : default_arena;
+}
+#else
+/*
+ * my_arena - The arena this thread allocates from. The first call adopts an arena that
+ * an exited thread left behind or makes a new one, the default arena is the last resort
+ */
+static arena_t my_arena(void)
+{
+    arena_t a;
+
+    if (thread_arena != NULL)
+    {
+        return thread_arena;
+    }
+    pthread_mutex_lock(&arenas_lock);
+    for (a = thread_arenas; a != NULL && __atomic_load_n(&a->owned, __ATOMIC_SEQ_CST); a = a->next)
+        ;
+    if (a == NULL && (a = mm_arena_create(thread_arena_size)) != NULL)
+    {
+        a->next = thread_arenas;
+        thread_arenas = a;
+    }
+    if (a != NULL)
+    {
+        __atomic_store_n(&a->owned, 1, __ATOMIC_SEQ_CST);
     }
-    return bestFit; /* if still NULL = no fit */
-                    /* if we got to this point then either a block with a higher remainder is used, or a block was not found :( */
+    pthread_mutex_unlock(&arenas_lock);
+
+    thread_arena = (a != NULL) ? a : default_arena;
+    thread_register(); /* the arena is given up when the thread exits */
+    return thread_arena;
 }
+#endif
 
 /*
- * coalesce - boundary tag coalescing. Return ptr to coalesced block
+ * remote_free - Push bp on the queue of the thread that owns arena a, without taking any lock.
+ * Returns 0 if nobody owns the arena and the caller has to free bp itself
  */
-static void *coalesce(void *bp)
+static int remote_free(arena_t a, void *bp)
 {
-    size_t prev_alloc = GET_ALLOC(FTRP(PREV_BLKP(bp))); 
-    size_t next_alloc = GET_ALLOC(HDRP(NEXT_BLKP(bp)));
-    size_t size = GET_SIZE(HDRP(bp));
+    void *head;
 
-    if (prev_alloc && next_alloc)           /* if both neighbor blocks are allocated we have nothing to coalesce */
-    { /* Case 1 */                          /* and the pointer is returned unchaged*/
+    if (!REMOTE_FREE || !__atomic_load_n(&a->owned, __ATOMIC_SEQ_CST))
+    {
+        return 0;
+    }
+    head = __atomic_load_n(&a->remote, __ATOMIC_RELAXED);
+    do
+    { /* nothing is ever popped off alone, the owner takes the whole queue, so there is no ABA */
+        *(void **)bp = head;
+    } while (!__atomic_compare_exchange_n(&a->remote, &head, bp, 1, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+
+    if (!__atomic_load_n(&a->owned, __ATOMIC_SEQ_CST))
+    { /* the owner exited meanwhile and may have drained the queue before the push */
+        LOCK(a);
+        remote_drain(a);
+        UNLOCK(a);
+    }
+    return 1;
+}
+
+/*
+ * remote_drain - Free everything on the remote free queue of a, the caller holds the lock
+ */
+static void remote_drain(arena_t a)
+{
+    void *bp, *next;
+
+    if (__atomic_load_n(&a->remote, __ATOMIC_RELAXED) == NULL)
+    {
+        return;
+    }
+    for (bp = __atomic_exchange_n(&a->remote, NULL, __ATOMIC_SEQ_CST); bp != NULL; bp = next)
+    {
+        next = *(void **)bp;
+        heap_free(a, bp);
+    }
+}
+#endif
+
+/*
+ * map_alloc - Give a request of size bytes a mapping of its own, the header before the payload
+ * holds the size of the mapping
+ */
+static void *map_alloc(size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t msize = (size + CHUNK_HDR + page - 1) & ~(page - 1);
+    char *start;
+
+    if ((start = mem_map(msize)) == NULL)
+    {
+        return NULL;
+    }
+    __atomic_add_fetch(&mapped_bytes, msize, __ATOMIC_RELAXED);
+    PUT(start + CHUNK_HDR - WSIZE, PACK(msize, MAPPED));
+    return start + CHUNK_HDR;
+}
+
+/*
+ * map_free - Unmap a mapped chunk
+ */
+static void map_free(void *bp)
+{
+    __atomic_sub_fetch(&mapped_bytes, GET_SIZE(HDRP(bp)), __ATOMIC_RELAXED);
+    mem_unmap((char *)bp - CHUNK_HDR);
+}
+
+/*
+ * map_realloc - Resize a mapped chunk. mremap moves the pages when the mapping can't grow where it
+ * is, so the payload is never copied. A chunk that shrinks below MMAP_THRESHOLD moves to the heap
+ */
+static void *map_realloc(void *bp, size_t size)
+{
+    size_t page = mem_pagesize();
+    size_t oldSize = GET_SIZE(HDRP(bp));
+    size_t msize = (size + CHUNK_HDR + page - 1) & ~(page - 1);
+    char *start;
+    void *newp;
+
+    if (size < MMAP_THRESHOLD)
+    {
+        if ((newp = mm_malloc(size)) == NULL)
+        {
+            return NULL;
+        }
+        memcpy(newp, bp, size);
+        map_free(bp);
+        return newp;
+    }
+    if (msize == oldSize)
+    {
         return bp;
     }
-    else if (prev_alloc && !next_alloc)    /* if the block on the left is allocated and the one on the left isn't, we move the footer*/
-    { /* Case 2 */                         /* of the currant block and then change the size in both the header and footer*/
-        removeFromList(NEXT_BLKP(bp));     /* the block on the right is removed from the free list since it is now merged with the currant*/
-        size += GET_SIZE(HDRP(NEXT_BLKP(bp)));
-        PUT(HDRP(bp), PACK(size, 0));
-        PUT(FTRP(bp), PACK(size, 0));
+    if ((start = mem_remap((char *)bp - CHUNK_HDR, msize)) == NULL)
+    {
+        return NULL;
     }
-    else if (!prev_alloc && next_alloc)   /* if the one on the right is allocated but the one on the left isn't, we move the header and then*/
-    { /* Case 3 */                        /* change the size, in this case the currant block is removed from the free list since it has the header */
-        removeFromList(bp);
-        size += GET_SIZE(HDRP(PREV_BLKP(bp)));
-        PUT(FTRP(bp), PACK(size, 0));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+    if (msize > oldSize)
+    {
+        __atomic_add_fetch(&mapped_bytes, msize - oldSize, __ATOMIC_RELAXED);
     }
     else
-    { /* Case 4 */                         /* in the last case both blocks ar unallocated, and we change the header of the previous block and the footer of the next*/
-        removeFromList(NEXT_BLKP(bp));     /* the middle part is garbage and is ignored*/
-        removeFromList(bp);                /* here we need to remove the currant and the next block from the free list since the previous block has the header */
-        size += GET_SIZE(HDRP(PREV_BLKP(bp))) +
-                GET_SIZE(FTRP(NEXT_BLKP(bp)));
-        PUT(HDRP(PREV_BLKP(bp)), PACK(size, 0));
-        PUT(FTRP(NEXT_BLKP(bp)), PACK(size, 0));
-        bp = PREV_BLKP(bp);
+    {
+        __atomic_sub_fetch(&mapped_bytes, oldSize - msize, __ATOMIC_RELAXED);
     }
+    PUT(start + CHUNK_HDR - WSIZE, PACK(msize, MAPPED));
+    return start + CHUNK_HDR;
+}
 
-    return bp;
+#ifdef SCAVENGE
+/*
+ * scavenger_start - Start the scavenger thread, once for the whole process
+ */
+static void scavenger_start(void)
+{
+    pthread_t tid;
+
+    if (pthread_create(&tid, NULL, scavenger, NULL) == 0)
+    {
+        pthread_detach(tid);
+    }
+}
+
+/*
+ * scavenger - Thread routine, every SCAVENGE_MS starts a new round and looks through every arena.
+ * arenas_lock is only held to read the front of the list, new arenas go in front of it and the
+ * rest of the list never changes, so threads getting an arena don't wait for the whole round
+ */
+static void *scavenger(void *arg)
+{
+    arena_t a, first;
+
+    for (;;)
+    {
+        usleep(SCAVENGE_MS * 1000);
+        __atomic_add_fetch(&scavenge_round, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&scavenge_lock);
+        pthread_mutex_lock(&arenas_lock);
+        first = thread_arenas;
+        pthread_mutex_unlock(&arenas_lock);
+        if (default_arena != NULL)
+        {
+            scavenge(default_arena);
+        }
+        for (a = first; a != NULL; a = a->next)
+        {
+            scavenge(a);
+        }
+        pthread_mutex_unlock(&scavenge_lock);
+    }
+    return NULL;
+}
+
+/*
+ * scavenge - Give back the pages of the free blocks in a that were freed SCAVENGE_DECAY rounds ago
+ * or more. The header, the links and the footer stay so the block is still a normal free block,
+ * the pages come back zeroed when it is used again. An arena that is busy waits for the next round
+ * so mallocs never wait on the scavenger for long
+ */
+static void scavenge(arena_t a)
+{
+    size_t round = __atomic_load_n(&scavenge_round, __ATOMIC_RELAXED);
+    size_t len;
+    char *bp, *lo;
+
+    if (pthread_mutex_trylock(&a->lock) != 0)
+    {
+        return;
+    }
+    for (bp = a->heap_listp; GET_SIZE(HDRP(bp)) > 0; bp = NEXT_BLKP(bp))
+    {
+        if (!GET_ALLOC(HDRP(bp)) && GET_SIZE(HDRP(bp)) >= SCAVENGE_MIN &&
+            GET(STAMPP(bp)) != RELEASED && round - GET(STAMPP(bp)) >= SCAVENGE_DECAY)
+        {
+            if ((len = free_pages(bp, &lo)) > 0)
+            {
+                mem_release(lo, len);
+            }
+            PUT(STAMPP(bp), RELEASED);
+        }
+    }
+    UNLOCK(a);
+}
+
+/*
+ * free_pages - The whole pages inside the free block bp past its links and before its stamp,
+ * lo is set to the first of them and the bytes they span are returned
+ */
+static size_t free_pages(void *bp, char **lo)
+{
+    size_t page = mem_pagesize();
+    char *hi = (char *)((size_t)STAMPP(bp) & ~(page - 1));
+
+    *lo = (char *)(((size_t)bp + FREE_LINKS + page - 1) & ~(page - 1));
+    return hi > *lo ? hi - *lo : 0;
 }
+#endif
 
 static void printblock(void *bp)
 {
@@ -508,75 +2565,374 @@ static void printblock(void *bp)
 
     hsize = GET_SIZE(HDRP(bp));
     halloc = GET_ALLOC(HDRP(bp));
-    fsize = GET_SIZE(FTRP(bp));
-    falloc = GET_ALLOC(FTRP(bp));
 
     if (hsize == 0)
     { /* if size = 0 , then it's the epilog or something is wrong */
         printf("%p: EOL\n", bp);
         return;
     }
+    if (halloc)
+    { /* allocated blocks have no footer */
+        printf("%p: header: [%zu:%c]\n", bp, hsize, 'a');
+        return;
+    }
 
-    printf("%p: header: [%d:%c] footer: [%d:%c]\n", bp,
+    fsize = GET_SIZE(FTRP(bp));
+    falloc = GET_ALLOC(FTRP(bp));
+    printf("%p: header: [%zu:%c] footer: [%zu:%c]\n", bp,
            hsize, (halloc ? 'a' : 'f'),
            fsize, (falloc ? 'a' : 'f'));
 }
 
 static void checkblock(void *bp)
 {
-    if ((size_t)bp % 8)
+    if ((size_t)bp % ALIGNMENT)
     { /* see if the block is aligned */
         printf("Error: %p is not doubleword aligned\n", bp);
     }
-    if (GET(HDRP(bp)) != GET(FTRP(bp)))
-    { /* check if the headers and footer match */
+    if (!GET_ALLOC(HDRP(bp)) && GET(HDRP(bp)) != GET(FTRP(bp)))
+    { /* check if the headers and footer of a free block match */
         printf("Error: header does not match footer\n");
     }
+    if (!GET_ALLOC(HDRP(bp)) && !GET_ALLOC(HDRP(NEXT_BLKP(bp))))
+    { /* two free blocks in a row escaped coalescing */
+        printf("Error: contiguous free blocks\n");
+    }
+    if (!GET_ALLOC(HDRP(bp)) != !GET_PREV_ALLOC(HDRP(NEXT_BLKP(bp))))
+    { /* the next block must know if this one is allocated */
+        printf("Error: prev allocated bit of the next block is wrong\n");
+    }
+}
+
+#if FREE_INDEX == TREE
+/* 
+ * addToList - insert bp in to the treap. We walk down until bp has a higher priority
+ * than the subtree root and then split that subtree in to the nodes smaller and bigger than bp
+ */
+void addToList(arena_t a, void *bp)
+{
+    treeNode newNode = (treeNode)bp;
+    link_t *link = &a->findex.root;
+    link_t *left = &newNode->left;
+    link_t *right = &newNode->right;
+    treeNode node;
+    unsigned int priority = PRIORITY(bp);
+
+    STAMP(bp); /* the scavenger ages free blocks from here */
+
+    while ((node = FROM_LINK(a, *link)) != NULL && PRIORITY(node) >= priority)
+    {
+        link = TREE_LESS(bp, node) ? &node->left : &node->right;
+    }
+    while (node != NULL)
+    { /* everything smaller goes down the left spine of the new node, bigger down the right */
+        if (TREE_LESS(node, bp))
+        {
+            *left = TO_LINK(a, node);
+            left = &node->right;
+            node = RIGHT(a, node);
+        }
+        else
+        {
+            *right = TO_LINK(a, node);
+            right = &node->left;
+            node = LEFT(a, node);
+        }
+    }
+    *left = 0;
+    *right = 0;
+    *link = TO_LINK(a, newNode);
+}
+/* 
+ * removeFromList - take bp out of the treap by merging its two subtrees in its place,
+ * bp must still have the size it was inserted with
+ */
+void removeFromList(arena_t a, void *bp)
+{
+    treeNode nodeToDelete = (treeNode)bp;
+    link_t *link = &a->findex.root;
+    link_t self = TO_LINK(a, bp);
+    treeNode left = LEFT(a, nodeToDelete);
+    treeNode right = RIGHT(a, nodeToDelete);
+    treeNode node;
+
+    while (*link != self)
+    {
+        node = FROM_LINK(a, *link);
+        link = TREE_LESS(bp, node) ? &node->left : &node->right;
+    }
+    while (left != NULL && right != NULL)
+    { /* the child with the higher priority becomes the new subtree root */
+        if (PRIORITY(left) > PRIORITY(right))
+        {
+            *link = TO_LINK(a, left);
+            link = &left->right;
+            left = RIGHT(a, left);
+        }
+        else
+        {
+            *link = TO_LINK(a, right);
+            link = &right->left;
+            right = LEFT(a, right);
+        }
+    }
+    *link = TO_LINK(a, (left != NULL) ? left : right);
+    nodeToDelete->left = 0;
+    nodeToDelete->right = 0;
+}
+
+/*
+ * treeChecker - checks the order and heap property of the subtree under node and
+ * returns how many blocks are in it
+ */
+static int treeChecker(arena_t a, treeNode node)
+{
+    int count = 0;
+    treeNode left, right;
+    for (; node != NULL; node = right)
+    {
+        left = LEFT(a, node);
+        right = RIGHT(a, node);
+        if (GET_ALLOC(HDRP(node)))
+        { /* make sure no allocated blocks are in the tree */
+            printf("Allocated block in free tree!!\n");
+        }
+        if ((left != NULL && (!TREE_LESS(left, node) || PRIORITY(left) > PRIORITY(node))) ||
+            (right != NULL && (!TREE_LESS(node, right) || PRIORITY(right) > PRIORITY(node))))
+        { /* the children must be on the correct side and never have a higher priority */
+            printf("Free tree out of order!!\n");
+            printblock(node);
+        }
+        count += treeChecker(a, left) + 1;
+    }
+    return count;
 }
 
+static int freeListChecker(arena_t a)
+{
+    return treeChecker(a, FROM_LINK(a, a->findex.root));
+}
+#else
 /* 
- *this function inserts the new freeListNodes at the top of the list  
+ *this function inserts the new freeListNodes at the top of the list for their size
  */
-void addToList(void *bp)
+void addToList(arena_t a, void *bp)
 { /* LIFO */
+    int index = list_index(GET_SIZE(HDRP(bp)));
     listNode newNode = (listNode)bp;
-    newNode->next = LISTHEAD->next;
-    newNode->prev = LISTHEAD;
-    if (LISTHEAD->next != NULL)
+    listNode head = LISTHEAD(a, index);
+    listNode next = NEXT(a, head);
+    STAMP(bp); /* the scavenger ages free blocks from here */
+#if FIT_POLICY == ADDRESS_FIT
+    link_t *update[SKIP_LEVELS];
+    int level, height = skip_height(bp);
+
+    head = skip_find(a, index, bp, update);
+    next = NEXT(a, head);
+    while (next != NULL && next < newNode)
+    { /* address ordered, bp goes after the last block below it */
+        head = next;
+        next = NEXT(a, next);
+    }
+    for (level = 0; level < height; level++)
+    { /* and in to the express lanes its tower reaches */
+        SKIP(bp)[level] = *update[level];
+        *update[level] = TO_LINK(a, bp);
+    }
+#endif
+    newNode->next = head->next;
+    newNode->prev = TO_LINK(a, head);
+    if (next != NULL)
     {
-        LISTHEAD->next->prev = newNode;
+        next->prev = TO_LINK(a, newNode);
     }
-    LISTHEAD->next = newNode;
+    head->next = TO_LINK(a, newNode);
+#if FREE_INDEX == TLSF
+    a->findex.fl_bitmap |= 1U << (index / SL_COUNT); /* the list is not empty anymore */
+    a->findex.sl_bitmap[index / SL_COUNT] |= 1U << (index % SL_COUNT);
+#endif
 }
 /* 
  *this function removes the node that bp points to and connects the neighbor nodes to each other 
  */
-void removeFromList(void *bp)
-{ /* LISTHEAD er alltaf fyrsta node */
+void removeFromList(arena_t a, void *bp)
+{ /* the list head is always the first node so prev is never NULL */
     listNode nodeToDelete = (listNode)bp;
-    if (nodeToDelete->next != NULL)
+    listNode next = NEXT(a, nodeToDelete);
+    listNode prev = PREV(a, nodeToDelete);
+#if FIT_POLICY == ADDRESS_FIT
+    int level, height = skip_height(bp);
+    link_t *update[SKIP_LEVELS];
+
+    if (height > 0)
+    { /* most blocks have no tower and come out of the list without a search */
+        skip_find(a, list_index(GET_SIZE(HDRP(bp))), bp, update);
+        for (level = 0; level < height; level++)
+        {
+            *update[level] = SKIP(bp)[level];
+        }
+    }
+#endif
+#if FIT_POLICY == NEXT_FIT
+    link_t *rover = &a->findex.rover[list_index(GET_SIZE(HDRP(bp)))];
+    if (*rover == TO_LINK(a, bp))
+    { /* the next search starts at the block after it */
+        *rover = nodeToDelete->next;
+    }
+#endif
+    if (next != NULL)
+    {
+        next->prev = nodeToDelete->prev;
+    }
+#if FREE_INDEX == TLSF
+    else if (prev >= a->findex.lists && prev < a->findex.lists + NUM_LISTS)
+    { /* the last node of a list was removed, clear its bit and the first level bit if that was the last list */
+        int index = prev - a->findex.lists;
+        a->findex.sl_bitmap[index / SL_COUNT] &= ~(1U << (index % SL_COUNT));
+        if (a->findex.sl_bitmap[index / SL_COUNT] == 0)
+        {
+            a->findex.fl_bitmap &= ~(1U << (index / SL_COUNT));
+        }
+    }
+#endif
+    prev->next = nodeToDelete->next;
+    nodeToDelete->prev = 0;
+    nodeToDelete->next = 0;
+}
+
+#if FIT_POLICY == ADDRESS_FIT
+/*
+ * skip_height - how many express links the tower of free block bp has, it only
+ * depends on the address and size of bp so it's the same when bp is taken out again
+ */
+static int skip_height(void *bp)
+{
+    unsigned long long hash = (((unsigned long long)(size_t)bp >> 3) * 0x9E3779B97F4A7C15ULL) >> 32; /* the well mixed high bits */
+    size_t used = OVERHEAD + sizeof(struct freeNode); /* what every free block holds already */
+    int height = 0;
+
+#ifdef SCAVENGE
+    used += WSIZE; /* the stamp sits before the footer */
+#endif
+    while ((hash & 3) == 0 && height < SKIP_LEVELS && used + (height + 1) * sizeof(link_t) <= GET_SIZE(HDRP(bp)))
+    { /* a quarter of the blocks on a level go up to the next */
+        height++;
+        hash >>= 2;
+    }
+    return height;
+}
+
+/*
+ * skip_find - find where bp goes in the address ordered list of class index, going down
+ * the express lanes from the top. update[i] is left at the link on level i + 1 that points
+ * past bp, and the last block below bp on the lowest express lane is returned, or the list head
+ */
+static listNode skip_find(arena_t a, int index, void *bp, link_t **update)
+{
+    listNode node = LISTHEAD(a, index);
+    link_t *link;
+    int level;
+
+    for (level = SKIP_LEVELS - 1; level >= 0; level--)
     {
-        nodeToDelete->next->prev = nodeToDelete->prev;
+        link = (node == LISTHEAD(a, index)) ? &a->findex.skip[index][level] : &SKIP(node)[level];
+        while (*link != 0 && (char *)FROM_LINK(a, *link) < (char *)bp)
+        {
+            node = FROM_LINK(a, *link);
+            link = &SKIP(node)[level];
+        }
+        update[level] = link;
     }
-    nodeToDelete->prev->next = nodeToDelete->next;
-    nodeToDelete->prev = NULL;
-    nodeToDelete->next = NULL;
+    return node;
 }
+#endif
 
-static void freeListChecker()
+static int freeListChecker(arena_t a)
 {
-    listNode last = LISTHEAD, tmp;
-    for (tmp = LISTHEAD->next; tmp != NULL; tmp = tmp->next, last = last->next)
+    int index, count = 0;
+    listNode last, tmp;
+    for (index = 0; index < NUM_LISTS; index++)
     {
-        if (!(tmp->prev == last))
-        { /* check to see if the next block points to me as previous */
-            printf("The first block is not correctly pointed to as the prev pointer of the second block\n");
-            printblock(tmp);
-            printblock(last);
+#if FIT_POLICY == NEXT_FIT
+        int rovers = 0;
+#endif
+#if FIT_POLICY == ADDRESS_FIT
+        int level, towers[SKIP_LEVELS] = {0};
+#endif
+        last = LISTHEAD(a, index);
+        for (tmp = NEXT(a, last); tmp != NULL; tmp = NEXT(a, tmp), last = NEXT(a, last))
+        {
+            count++;
+            if (!(PREV(a, tmp) == last))
+            { /* check to see if the next block points to me as previous */
+                printf("The first block is not correctly pointed to as the prev pointer of the second block\n");
+                printblock(tmp);
+                printblock(last);
+            }
+            if (GET_ALLOC(HDRP(tmp)))
+            { /* make sure no allocated blocks are in the free list */
+                printf("Allocated block in free list!!\n");
+            }
+            if (list_index(GET_SIZE(HDRP(tmp))) != index)
+            { /* make sure the block is in the list for its size */
+                printf("Block in the wrong size class list!!\n");
+                printblock(tmp);
+            }
+#if FIT_POLICY == ADDRESS_FIT
+            if (last != LISTHEAD(a, index) && last > tmp)
+            { /* the lists are kept in address order */
+                printf("Free list out of address order!!\n");
+                printblock(tmp);
+            }
+            for (level = 0; level < skip_height(tmp); level++)
+            {
+                towers[level]++;
+            }
+#endif
+#if FIT_POLICY == NEXT_FIT
+            if (a->findex.rover[index] == TO_LINK(a, tmp))
+            {
+                rovers++;
+            }
+#endif
+        }
+#if FREE_INDEX == TLSF
+        if (!(a->findex.sl_bitmap[index / SL_COUNT] & (1U << (index % SL_COUNT))) != (LISTHEAD(a, index)->next == 0))
+        { /* the bitmaps must say exactly which lists are non empty */
+            printf("Second level bitmap out of sync with list %d\n", index);
+        }
+        if (!(a->findex.fl_bitmap & (1U << (index / SL_COUNT))) != (a->findex.sl_bitmap[index / SL_COUNT] == 0))
+        {
+            printf("First level bitmap out of sync with list %d\n", index);
+        }
+#endif
+#if FIT_POLICY == NEXT_FIT
+        if (a->findex.rover[index] != 0 && rovers != 1)
+        { /* a rover must be one of the blocks of its own class */
+            printf("Rover of class %d is not in its list\n", index);
         }
-        if (GET_ALLOC(HDRP(tmp)))
-        { /* make sure no allocated blocks are in the free list */
-            printf("Allocated block in free list!!\n");
+#endif
+#if FIT_POLICY == ADDRESS_FIT
+        for (level = 0; level < SKIP_LEVELS; level++)
+        { /* every express lane holds exactly the blocks of the list whose tower reaches it, in order */
+            last = NULL;
+            for (tmp = FROM_LINK(a, a->findex.skip[index][level]); tmp != NULL; tmp = FROM_LINK(a, SKIP(tmp)[level]))
+            {
+                if (GET_ALLOC(HDRP(tmp)) || skip_height(tmp) <= level || (last != NULL && last > tmp))
+                {
+                    printf("Express lane %d of class %d is broken!!\n", level + 1, index);
+                    printblock(tmp);
+                }
+                towers[level]--;
+                last = tmp;
+            }
+            if (towers[level] != 0)
+            {
+                printf("Express lane %d of class %d is missing blocks\n", level + 1, index);
+            }
         }
+#endif
     }
+    return count;
 }
+#endif
@@ -6,6 +6,62 @@ extern void mm_free (void *ptr);
 extern void *mm_realloc(void *ptr, size_t size);
 extern void mm_checkheap(int verbose);
 
+/* How long the caller expects a block to live */
+typedef enum {
+    LIFETIME_UNKNOWN,
+    SHORT_LIVED,     /* goes again soon, like a buffer for one request */
+    LONG_LIVED       /* stays around, like a cache entry */
+} mm_hint_t;
+
+extern void *mm_malloc_hint(size_t size, mm_hint_t hint);
+
+/* What the allocator knows about its own memory use */
+typedef struct {
+    size_t heap_bytes;   /* bytes every arena and mapped chunk took from memlib */
+    size_t cached_bytes; /* of those, bytes free and waiting for reuse */
+    size_t largest_free; /* biggest free block, the rest of the cached bytes is scattered in smaller ones */
+    size_t realloc_moves; /* reallocs that had to copy the block somewhere else */
+    size_t realloc_stays; /* reallocs that kept the block where it was */
+    size_t moved_bytes;   /* payload bytes the moves copied */
+    size_t saved_bytes;   /* payload bytes the stays didn't have to copy */
+    size_t released_bytes; /* of the cached bytes, the ones the scavenger gave back to the system */
+    size_t sbrk_calls;    /* times an arena grew its heap */
+    size_t sbrk_bytes;    /* bytes the heaps grew by */
+    size_t split_min;     /* smallest remainder a block is split for, the biggest any arena uses */
+    size_t fit_slack;     /* remainder a fit is good enough with, the biggest any arena uses */
+} mm_stats_t;
+
+extern void mm_stats(mm_stats_t *stats);
+
+/* Heaps grow by at least min bytes, doubling up to max while they keep growing */
+extern void mm_set_extend(size_t min, size_t max);
+
+/* 
+ * Arenas are heaps of their own. Blocks must be freed to the arena they came
+ * from, and destroying an arena frees everything in it at once. mm_malloc
+ * and friends use the default arena that mm_init sets up.
+ */
+typedef struct arena *arena_t;
+
+extern arena_t mm_arena_create(size_t size);
+extern void *mm_arena_malloc(arena_t a, size_t size);
+extern void mm_arena_free(arena_t a, void *ptr);
+extern void *mm_arena_realloc(arena_t a, void *ptr, size_t size);
+extern void mm_arena_destroy(arena_t a);
+
+/*
+ * Regions hand out memory by bumping a pointer through chunks they take
+ * from mm_malloc. Nothing allocated from a region is freed on its own,
+ * mm_region_reset frees all of it at once and mm_region_destroy the region
+ * as well. A region is not thread safe, every thread should use its own.
+ */
+typedef struct mm_region *mm_region_t;
+
+extern mm_region_t mm_region_create(void);
+extern void *mm_region_alloc(mm_region_t r, size_t size);
+extern void mm_region_reset(mm_region_t r);
+extern void mm_region_destroy(mm_region_t r);
+
 /* 
  * Students work in teams of one or two.  Teams enter their team name, 
  * personal names and login IDs in a struct of this
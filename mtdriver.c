@@ -0,0 +1,459 @@
+/*
+ * mtdriver.c - Multithreaded replay benchmark for the thread safe mm.c
+ *
+ * Every thread replays the same trace files against the shared
+ * allocator, each with its own table of blocks, and the driver reports
+ * the combined throughput for 1, 2, 4, ... up to the requested number
+ * of threads so the scaling can be read straight off the table. Next to
+ * the throughput it shows how much memory the allocator took and how
+ * much of that it holds free while the finished threads are still alive.
+ *
+ * With -p the threads work in pairs instead, a producer makes a block
+ * for every allocation in the traces and hands it to its consumer, which
+ * frees it, so every free is a cross thread free.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define MAXLINE     1024 /* max string size */
+#define RING          64 /* blocks in flight between a producer and its consumer */
+
+/******************************
+ * The key compound data types
+ *****************************/
+
+/* Characterizes a single trace operation (allocator request) */
+typedef struct {
+    enum {ALLOC, FREE, REALLOC} type; /* type of request */
+    int index;                        /* index for free() to use later */
+    size_t size;                      /* byte size of alloc/realloc request */
+} traceop_t;
+
+/* Holds the information for one trace file */
+typedef struct {
+    int num_ids;         /* number of alloc/realloc ids */
+    int num_ops;         /* number of distinct requests */
+    traceop_t *ops;      /* array of requests */
+} trace_t;
+
+/* A producer hands its blocks to its consumer through one of these */
+typedef struct {
+    char *slots[RING];   /* blocks waiting to be freed */
+    unsigned head;       /* next slot the producer fills */
+    unsigned tail;       /* next slot the consumer empties */
+} channel_t;
+
+/* What one replay thread needs */
+typedef struct {
+    int id;              /* thread number, used as the fill byte */
+    long ops;            /* requests this thread performed */
+    channel_t *chan;     /* shared with the partner in -p mode */
+} worker_t;
+
+/********************
+ * Global variables
+ *******************/
+
+/* Directory where default tracefiles are found */
+static char tracedir[MAXLINE] = TRACEDIR;
+
+/* The filenames of the default tracefiles */
+static char *default_tracefiles[] = {
+    DEFAULT_TRACEFILES, NULL
+};
+
+static trace_t **traces;     /* every trace, shared read only by the threads */
+static int num_tracefiles;   /* the number of traces in that array */
+static int reps = 10;        /* times each thread replays every trace (-r) */
+static int pairs = 0;        /* run producer/consumer pairs (-p) */
+static int idle_ms = 0;      /* time the heap sits idle before the stats are taken (-w) */
+static pthread_barrier_t parked;  /* every thread is done but hasn't exited */
+static pthread_barrier_t release; /* the stats are taken, threads may exit */
+
+/*********************
+ * Function prototypes
+ *********************/
+static trace_t *read_trace(char *tracedir, char *filename);
+static void *replay(void *arg);
+static void *produce(void *arg);
+static void *consume(void *arg);
+static double run(int nthreads, long *ops, mm_stats_t *stats);
+static void *park(void);
+static void usage(void);
+static void unix_error(char *msg);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int i, c;
+    char **tracefiles = default_tracefiles;
+    int max_threads = 0;          /* largest thread count to run (-n) */
+    size_t max_heap = MAX_HEAP;   /* most the heap can grow to (-m) */
+    int hugepages = 0;            /* back the heaps with huge pages (-H) */
+    double secs, base = 0;
+    long ops;
+    mm_stats_t stats;
+
+    while ((c = getopt(argc, argv, "f:t:n:r:w:m:pHh")) != EOF) {
+        switch (c) {
+        case 'f': /* Use one specific trace file only (relative to curr dir) */
+            if ((tracefiles = malloc(2*sizeof(char *))) == NULL)
+		unix_error("ERROR: malloc failed in main");
+	    strcpy(tracedir, "./");
+            tracefiles[0] = strdup(optarg);
+            tracefiles[1] = NULL;
+            break;
+	case 't': /* Directory where the traces are located */
+	    if (tracefiles != default_tracefiles) /* ignore if -f already encountered */
+		break;
+	    strcpy(tracedir, optarg);
+	    if (tracedir[strlen(tracedir)-1] != '/')
+		strcat(tracedir, "/"); /* path always ends with "/" */
+	    break;
+        case 'n': /* Largest number of threads */
+            max_threads = atoi(optarg);
+            break;
+        case 'r': /* Replays of every trace per thread */
+            reps = atoi(optarg);
+            break;
+        case 'p': /* Producer/consumer pairs */
+            pairs = 1;
+            break;
+        case 'w': /* Idle time before the stats */
+            idle_ms = atoi(optarg);
+            break;
+        case 'm': /* Most the heap can grow to */
+            max_heap = (size_t)atol(optarg) << 20;
+            break;
+        case 'H': /* Transparent huge pages for the heap */
+            hugepages = 1;
+            break;
+        case 'h': /* Print this message */
+	    usage();
+            exit(0);
+        default:
+	    usage();
+            exit(1);
+        }
+    }
+    if (max_threads <= 0)
+        max_threads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (pairs && max_threads < 2)
+        max_threads = 2;
+
+    /* Read every trace once, the threads share them */
+    for (num_tracefiles = 0; tracefiles[num_tracefiles]; num_tracefiles++)
+	;
+    if ((traces = malloc(num_tracefiles * sizeof(trace_t *))) == NULL)
+	unix_error("ERROR: malloc failed in main");
+    for (i = 0; i < num_tracefiles; i++)
+	traces[i] = read_trace(tracedir, tracefiles[i]);
+
+    mem_configure(max_heap, hugepages);
+    mem_init();
+    printf("threads        ops      secs     Kops  speedup    heap(KB)  cached(KB) released(KB)\n");
+    for (c = pairs ? 2 : 1; ; c = (c * 2 < max_threads) ? c * 2 : max_threads) {
+	secs = run(c, &ops, &stats);
+	if (base == 0)
+	    base = ops / secs;
+	printf("%7d %10ld %9.6f %8.0f %8.2f %11lu %11lu %12lu\n",
+	       c, ops, secs, ops / secs / 1e3, ops / secs / base,
+	       (unsigned long)(stats.heap_bytes / 1024),
+	       (unsigned long)(stats.cached_bytes / 1024),
+	       (unsigned long)(stats.released_bytes / 1024));
+	if (c == max_threads)
+	    break;
+    }
+    /* no mem_deinit, a background scavenger may still be looking at the heap */
+    exit(0);
+}
+
+/*
+ * run - Start nthreads replay threads on a fresh heap and time them,
+ *     the stats are taken once all of them are done but before they exit
+ */
+static double run(int nthreads, long *ops, mm_stats_t *stats)
+{
+    pthread_t *tids;
+    worker_t *workers;
+    struct timespec start, end;
+    int i;
+
+    if (pairs)
+	nthreads &= ~1; /* every producer has a consumer */
+    if ((tids = malloc(nthreads * sizeof(pthread_t))) == NULL ||
+	(workers = malloc(nthreads * sizeof(worker_t))) == NULL)
+	unix_error("ERROR: malloc failed in run");
+    pthread_barrier_init(&parked, NULL, nthreads + 1);
+    pthread_barrier_init(&release, NULL, nthreads + 1);
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+	fprintf(stderr, "ERROR: mm_init failed\n");
+	exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (i = 0; i < nthreads; i++) {
+	workers[i].id = i;
+	workers[i].ops = 0;
+	workers[i].chan = NULL;
+	if (pairs && i % 2 == 0 &&
+	    (workers[i].chan = calloc(1, sizeof(channel_t))) == NULL)
+	    unix_error("ERROR: calloc failed in run");
+	if (pairs && i % 2 == 1)
+	    workers[i].chan = workers[i - 1].chan;
+	if (pthread_create(&tids[i], NULL,
+			   !pairs ? replay : (i % 2 == 0 ? produce : consume),
+			   &workers[i]) != 0)
+	    unix_error("ERROR: pthread_create failed in run");
+    }
+    pthread_barrier_wait(&parked);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (idle_ms > 0) /* give a background scavenger time to run */
+	usleep(idle_ms * 1000);
+    mm_stats(stats);
+    pthread_barrier_wait(&release);
+
+    *ops = 0;
+    for (i = 0; i < nthreads; i++) {
+	pthread_join(tids[i], NULL);
+	*ops += workers[i].ops;
+    }
+    pthread_barrier_destroy(&parked);
+    pthread_barrier_destroy(&release);
+
+    for (i = 0; i < nthreads; i += 2)
+	if (pairs)
+	    free(workers[i].chan);
+    free(tids);
+    free(workers);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * replay - Thread routine, runs every trace reps times with its own block table
+ */
+static void *replay(void *arg)
+{
+    worker_t *w = arg;
+    trace_t *trace;
+    char **blocks;
+    int r, t, i, index;
+    size_t size;
+
+    for (r = 0; r < reps; r++) {
+	for (t = 0; t < num_tracefiles; t++) {
+	    trace = traces[t];
+	    if ((blocks = calloc(trace->num_ids, sizeof(char *))) == NULL)
+		unix_error("ERROR: calloc failed in replay");
+	    for (i = 0; i < trace->num_ops; i++) {
+		index = trace->ops[i].index;
+		size = trace->ops[i].size;
+		switch (trace->ops[i].type) {
+		case ALLOC:
+		    blocks[index] = mm_malloc(size);
+		    break;
+		case REALLOC:
+		    blocks[index] = mm_realloc(blocks[index], size);
+		    break;
+		case FREE:
+		    mm_free(blocks[index]);
+		    blocks[index] = NULL;
+		    break;
+		}
+		if (trace->ops[i].type != FREE) {
+		    if (blocks[index] == NULL) {
+			fprintf(stderr, "ERROR: thread %d ran out of memory\n", w->id);
+			exit(1);
+		    }
+		    blocks[index][0] = w->id; /* touch the block like a real program would */
+		}
+	    }
+	    for (i = 0; i < trace->num_ids; i++) /* some traces leave blocks behind */
+		if (blocks[i] != NULL)
+		    mm_free(blocks[i]);
+	    free(blocks);
+	    w->ops += trace->num_ops;
+	}
+    }
+    return park();
+}
+
+/*
+ * park - Wait with everything this thread cached until main has the stats
+ */
+static void *park(void)
+{
+    pthread_barrier_wait(&parked);
+    pthread_barrier_wait(&release);
+    return NULL;
+}
+
+/*
+ * produce - Thread routine for -p, makes a block for every allocation in
+ *     the traces and passes it on to the consumer, a NULL ends the stream.
+ *     Reallocs are left out, the growing blocks would only measure the
+ *     heap size while the consumer lags behind
+ */
+static void *produce(void *arg)
+{
+    worker_t *w = arg;
+    channel_t *chan = w->chan;
+    trace_t *trace;
+    char *bp;
+    int r, t, i;
+
+    for (r = 0; r < reps; r++) {
+	for (t = 0; t < num_tracefiles; t++) {
+	    trace = traces[t];
+	    for (i = 0; i < trace->num_ops; i++) {
+		if (trace->ops[i].type != ALLOC)
+		    continue;
+		if ((bp = mm_malloc(trace->ops[i].size)) == NULL) {
+		    fprintf(stderr, "ERROR: thread %d ran out of memory\n", w->id);
+		    exit(1);
+		}
+		bp[0] = w->id;
+		while (chan->head - __atomic_load_n(&chan->tail, __ATOMIC_ACQUIRE) == RING)
+		    sched_yield(); /* the consumer is behind */
+		chan->slots[chan->head % RING] = bp;
+		__atomic_store_n(&chan->head, chan->head + 1, __ATOMIC_RELEASE);
+		w->ops++;
+	    }
+	}
+    }
+    while (chan->head - __atomic_load_n(&chan->tail, __ATOMIC_ACQUIRE) == RING)
+	sched_yield();
+    chan->slots[chan->head % RING] = NULL;
+    __atomic_store_n(&chan->head, chan->head + 1, __ATOMIC_RELEASE);
+    return park();
+}
+
+/*
+ * consume - Thread routine for -p, frees whatever its producer sends
+ */
+static void *consume(void *arg)
+{
+    worker_t *w = arg;
+    channel_t *chan = w->chan;
+    char *bp;
+
+    for (;;) {
+	while (__atomic_load_n(&chan->head, __ATOMIC_ACQUIRE) == chan->tail)
+	    sched_yield(); /* nothing to free yet */
+	bp = chan->slots[chan->tail % RING];
+	__atomic_store_n(&chan->tail, chan->tail + 1, __ATOMIC_RELEASE);
+	if (bp == NULL)
+	    return park();
+	mm_free(bp);
+	w->ops++;
+    }
+}
+
+/*
+ * read_trace - read a trace file and store it in memory
+ */
+static trace_t *read_trace(char *tracedir, char *filename)
+{
+    FILE *tracefile;
+    trace_t *trace;
+    char type[MAXLINE];
+    char path[MAXLINE];
+    unsigned index;
+    size_t size;
+    int op_index, unused;
+
+    if ((trace = (trace_t *) malloc(sizeof(trace_t))) == NULL)
+	unix_error("malloc 1 failed in read_trace");
+
+    /* Read the trace file header */
+    strcpy(path, tracedir);
+    strcat(path, filename);
+    if ((tracefile = fopen(path, "r")) == NULL) {
+	fprintf(stderr, "Could not open %s in read_trace\n", path);
+	exit(1);
+    }
+    fscanf(tracefile, "%d", &unused);                /* suggested heap size */
+    fscanf(tracefile, "%d", &(trace->num_ids));
+    fscanf(tracefile, "%d", &(trace->num_ops));
+    fscanf(tracefile, "%d", &unused);                /* weight */
+
+    if ((trace->ops =
+	 (traceop_t *)malloc(trace->num_ops * sizeof(traceop_t))) == NULL)
+	unix_error("malloc 2 failed in read_trace");
+
+    /* read every request line in the trace file */
+    op_index = 0;
+    while (op_index < trace->num_ops && fscanf(tracefile, "%s", type) != EOF) {
+	switch(type[0]) {
+	case 'a':
+	    fscanf(tracefile, "%u %zu", &index, &size);
+	    trace->ops[op_index].type = ALLOC;
+	    break;
+	case 'r':
+	    fscanf(tracefile, "%u %zu", &index, &size);
+	    trace->ops[op_index].type = REALLOC;
+	    break;
+	case 'f':
+	    fscanf(tracefile, "%u", &index);
+	    size = 0;
+	    trace->ops[op_index].type = FREE;
+	    break;
+	default:
+	    printf("Bogus type character (%c) in tracefile %s\n",
+		   type[0], path);
+	    exit(1);
+	}
+	trace->ops[op_index].index = index;
+	trace->ops[op_index].size = size;
+	op_index++;
+    }
+    fclose(tracefile);
+    assert(trace->num_ops == op_index);
+
+    return trace;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: mtdriver [-hpH] [-f <file>] [-t <dir>] [-n <threads>] [-r <reps>] [-w <ms>] [-m <MB>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-f <file>     Use <file> as the trace file.\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-H            Ask for transparent huge pages for the heaps.\n");
+    fprintf(stderr, "\t-m <MB>       Let the shared heap grow to <MB> megabytes.\n");
+    fprintf(stderr, "\t-n <threads>  Scale up to <threads> threads (default: online cpus).\n");
+    fprintf(stderr, "\t-p            Producer threads allocate, consumer threads free.\n");
+    fprintf(stderr, "\t-r <reps>     Replay every trace <reps> times per thread (default 10).\n");
+    fprintf(stderr, "\t-t <dir>      Directory to find default traces.\n");
+    fprintf(stderr, "\t-w <ms>       Let the heap sit idle <ms> before measuring memory.\n");
+}
+
+/*
+ * unix_error - Report Unix-style error
+ */
+static void unix_error(char *msg)
+{
+    fprintf(stderr, "%s\n", msg);
+    exit(1);
+}
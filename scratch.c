@@ -0,0 +1,188 @@
+/*
+ * scratch.c - Request scoped allocation benchmark for mm.c
+ *
+ * Serves a stream of requests the way a server does. Every request
+ * allocates a random number of scratch objects, touches them and drops
+ * them all when it is done, and now and then leaves a session object
+ * behind that outlives it. The run is made twice with the same requests,
+ * once with mm_malloc and an mm_free for every scratch object, and once
+ * with the scratch objects in a region that is reset at the end of each
+ * request, and prints the time and the memory each way took.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+#include "bench.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define SESSIONS    256 /* session objects live at once, the oldest goes for a new one */
+#define SESSION_PCT  10 /* percent of the requests that start a session */
+
+/********************
+ * Global variables
+ *******************/
+
+static char **scratch;           /* the objects of the request being served */
+static char *sessions[SESSIONS]; /* the session objects, in a ring */
+
+/*********************
+ * Function prototypes
+ *********************/
+static double run(long num_requests, int max_objects, int use_region, mm_stats_t *stats);
+static size_t random_size(void);
+static void usage(void);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+    long num_requests = 100000;   /* requests in a run (-n) */
+    int max_objects = 256;        /* most scratch objects in a request (-o) */
+    size_t max_heap = 256 << 20;  /* most the heap can grow to (-m) */
+    unsigned long long start_seed;
+    double secs[2];
+    mm_stats_t stats[2];
+    int i;
+
+    while ((c = getopt(argc, argv, "n:o:s:m:h")) != EOF) {
+        switch (c) {
+        case 'n': /* Requests in a run */
+            num_requests = atol(optarg);
+            break;
+        case 'o': /* Most scratch objects in a request */
+            max_objects = atoi(optarg);
+            break;
+        case 's': /* Seed of the random numbers */
+            random_seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+        case 'm': /* Most the heap can grow to */
+            max_heap = (size_t)atol(optarg) << 20;
+            break;
+        case 'h': /* Print this message */
+	    usage();
+            exit(0);
+        default:
+	    usage();
+            exit(1);
+        }
+    }
+    if (num_requests <= 0 || max_objects <= 0) {
+        usage();
+        exit(1);
+    }
+    if ((scratch = malloc(max_objects * sizeof(char *))) == NULL)
+	unix_error("ERROR: malloc failed in main");
+
+    mem_configure(max_heap, 0);
+    mem_init();
+    start_seed = random_seed;
+    for (i = 0; i < 2; i++) {
+	random_seed = start_seed; /* both runs serve the same requests */
+	secs[i] = run(num_requests, max_objects, i, &stats[i]);
+    }
+
+    printf("mode       requests       secs  requests/s   heap(KB)\n");
+    for (i = 0; i < 2; i++)
+	printf("%-8s %10ld %10.3f %11.0f %10lu\n",
+	       i ? "region" : "free",
+	       num_requests,
+	       secs[i],
+	       num_requests / secs[i],
+	       (unsigned long)(stats[i].heap_bytes / 1024));
+    printf("The region reset is %.1f times as fast\n", secs[0] / secs[1]);
+    mem_deinit();
+    exit(0);
+}
+
+/*
+ * run - Serve num_requests requests on a fresh heap, with the scratch
+ *    objects in a region or each freed on its own, and return the seconds
+ *    it took. stats gets what the heap looked like at the end
+ */
+static double run(long num_requests, int max_objects, int use_region, mm_stats_t *stats)
+{
+    long req;
+    int i, n, next_session = 0;
+    size_t size;
+    mm_region_t region = NULL;
+    struct timespec start, end;
+
+    mem_reset_brk();
+    if (mm_init() < 0) {
+	fprintf(stderr, "ERROR: mm_init failed\n");
+	exit(1);
+    }
+    memset(sessions, 0, sizeof(sessions));
+    if (use_region && (region = mm_region_create()) == NULL) {
+	fprintf(stderr, "ERROR: mm_region_create failed\n");
+	exit(1);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (req = 0; req < num_requests; req++) {
+	n = 1 + next_random() % max_objects;
+	for (i = 0; i < n; i++) {
+	    size = random_size();
+	    scratch[i] = checked(use_region ? mm_region_alloc(region, size) : mm_malloc(size), size);
+	    touch(scratch[i], size);
+	}
+	if (next_random() % 100 < SESSION_PCT) { /* a session outlives the request */
+	    if (sessions[next_session] != NULL)
+		mm_free(sessions[next_session]);
+	    size = 64 + next_random() % 960;
+	    sessions[next_session] = checked(mm_malloc(size), size);
+	    next_session = (next_session + 1) % SESSIONS;
+	}
+	if (use_region) {
+	    mm_region_reset(region);
+	}
+	else {
+	    for (i = 0; i < n; i++)
+		mm_free(scratch[i]);
+	}
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    mm_stats(stats);
+    mm_region_destroy(region);
+    return (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+}
+
+/*
+ * random_size - Mostly small strings and nodes, a few bigger buffers
+ */
+static size_t random_size(void)
+{
+    unsigned long r = next_random() % 100;
+
+    if (r < 90)
+	return 8 + next_random() % 120;
+    if (r < 99)
+	return 128 + next_random() % 896;
+    return 1024 + next_random() % 7168;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: scratch [-h] [-n <requests>] [-o <objects>] [-s <seed>] [-m <MB>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-h              Print this message.\n");
+    fprintf(stderr, "\t-m <MB>         Let the heap grow to <MB> megabytes (default 256).\n");
+    fprintf(stderr, "\t-n <requests>   Serve <requests> requests each way (default 100000).\n");
+    fprintf(stderr, "\t-o <objects>    Allocate up to <objects> scratch objects a request (default 256).\n");
+    fprintf(stderr, "\t-s <seed>       Seed the random requests.\n");
+}
@@ -0,0 +1,131 @@
+/*
+ * spike.c - Heap trimming check for mm.c
+ *
+ * Allocates a spike of random blocks, small ones that go to the slabs
+ * mixed with big ones, frees all of them in random order and checks
+ * that the heap went back down to what trimming keeps. It does that a
+ * few times over and exits with 1 when the heap stayed up after any of
+ * the spikes.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "mm.h"
+#include "memlib.h"
+#include "config.h"
+#include "bench.h"
+
+/**********************
+ * Constants and macros
+ **********************/
+
+#define SPIKES   4 /* times the heap goes up and down */
+
+/*********************
+ * Function prototypes
+ *********************/
+static size_t random_size(void);
+static void usage(void);
+
+/**************
+ * Main routine
+ **************/
+int main(int argc, char **argv)
+{
+    int c;
+    int num_blocks = 20000;       /* blocks in a spike (-b) */
+    size_t max_left = 256 << 10;  /* most the heap may keep after a spike (-k) */
+    size_t max_heap = 256 << 20;  /* most the heap can grow to (-m) */
+    char **blocks;
+    char *p;
+    size_t size, peak;
+    mm_stats_t stats;
+    int i, j, spike, failed = 0;
+
+    while ((c = getopt(argc, argv, "b:k:s:m:h")) != EOF) {
+        switch (c) {
+        case 'b': /* Blocks in a spike */
+            num_blocks = atoi(optarg);
+            break;
+        case 'k': /* Most the heap may keep */
+            max_left = (size_t)atol(optarg) << 10;
+            break;
+        case 's': /* Seed of the random numbers */
+            random_seed = strtoull(optarg, NULL, 0) | 1;
+            break;
+        case 'm': /* Most the heap can grow to */
+            max_heap = (size_t)atol(optarg) << 20;
+            break;
+        case 'h': /* Print this message */
+	    usage();
+            exit(0);
+        default:
+	    usage();
+            exit(1);
+        }
+    }
+    if (num_blocks <= 0) {
+        usage();
+        exit(1);
+    }
+    if ((blocks = malloc(num_blocks * sizeof(char *))) == NULL)
+	unix_error("ERROR: malloc failed in main");
+
+    mem_configure(max_heap, 0);
+    mem_init();
+    if (mm_init() < 0) {
+	fprintf(stderr, "ERROR: mm_init failed\n");
+	exit(1);
+    }
+
+    printf("spike   peak(KB)   left(KB)\n");
+    for (spike = 1; spike <= SPIKES; spike++) {
+	for (i = 0; i < num_blocks; i++) {
+	    size = random_size();
+	    blocks[i] = checked(mm_malloc(size), size);
+	    touch(blocks[i], size);
+	}
+	mm_stats(&stats);
+	peak = stats.heap_bytes;
+	for (i = num_blocks; i > 0; i--) { /* free them in random order */
+	    j = next_random() % i;
+	    p = blocks[j];
+	    blocks[j] = blocks[i - 1];
+	    mm_free(p);
+	}
+	mm_stats(&stats);
+	printf("%5d %10lu %10lu%s\n", spike,
+	       (unsigned long)(peak / 1024),
+	       (unsigned long)(stats.heap_bytes / 1024),
+	       stats.heap_bytes > max_left ? "   the heap wasn't trimmed" : "");
+	if (stats.heap_bytes > max_left)
+	    failed = 1;
+    }
+    mem_deinit();
+    exit(failed);
+}
+
+/*
+ * random_size - Half small objects for the slabs, the rest up to 16KB
+ */
+static size_t random_size(void)
+{
+    if (next_random() % 2)
+	return 8 + next_random() % 56;
+    return 64 + next_random() % 16320;
+}
+
+/*
+ * usage - Explain the command line arguments
+ */
+static void usage(void)
+{
+    fprintf(stderr, "Usage: spike [-h] [-b <blocks>] [-k <KB>] [-s <seed>] [-m <MB>]\n");
+    fprintf(stderr, "Options\n");
+    fprintf(stderr, "\t-b <blocks>   Allocate <blocks> blocks in each spike (default 20000).\n");
+    fprintf(stderr, "\t-h            Print this message.\n");
+    fprintf(stderr, "\t-k <KB>       Fail when more than <KB> kilobytes are left (default 256).\n");
+    fprintf(stderr, "\t-m <MB>       Let the heap grow to <MB> megabytes (default 256).\n");
+    fprintf(stderr, "\t-s <seed>     Seed the random sizes and the order of the frees.\n");
+}